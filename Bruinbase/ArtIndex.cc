@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include <limits>
+#include "ArtIndex.h"
+
+using std::vector;
+
+//
+// the four node sizes of the adaptive radix tree
+//
+
+struct ArtIndex::Node {
+  unsigned char  type;   // the capacity of the node: 4, 16, 48 or 0 for 256
+  unsigned short count;  // # children in use
+};
+
+// up to 4 children, with their key bytes kept sorted
+struct ArtIndex::Node4 : ArtIndex::Node {
+  unsigned char keys[4];
+  Child         children[4];
+};
+
+// up to 16 children, with their key bytes kept sorted
+struct ArtIndex::Node16 : ArtIndex::Node {
+  unsigned char keys[16];
+  Child         children[16];
+};
+
+// up to 48 children. index[b] is the slot of the child for byte b plus one,
+// or zero if there is no such child.
+struct ArtIndex::Node48 : ArtIndex::Node {
+  unsigned char index[256];
+  Child         children[48];
+};
+
+// a child slot for every possible byte
+struct ArtIndex::Node256 : ArtIndex::Node {
+  Child children[256];
+};
+
+
+ArtIndex::ArtIndex()
+{
+  root = NULL;
+}
+
+ArtIndex::~ArtIndex()
+{
+  if (root != NULL) destroy(root, 0);
+}
+
+void ArtIndex::keyBytes(int key, unsigned char bytes[KEY_BYTES])
+{
+  // flip the sign bit so that negative keys sort before positive ones
+  unsigned int u = (unsigned int) key ^ 0x80000000u;
+  for (int i = KEY_BYTES - 1; i >= 0; i--) {
+    bytes[i] = u & 0xff;
+    u >>= 8;
+  }
+}
+
+ArtIndex::Child* ArtIndex::findChild(Node* node, unsigned char byte)
+{
+  switch (node->type) {
+  case 4: {
+    Node4* n = static_cast<Node4*>(node);
+    for (int i = 0; i < n->count; i++) {
+      if (n->keys[i] == byte) return &n->children[i];
+    }
+    return NULL;
+  }
+  case 16: {
+    Node16* n = static_cast<Node16*>(node);
+    for (int i = 0; i < n->count; i++) {
+      if (n->keys[i] == byte) return &n->children[i];
+    }
+    return NULL;
+  }
+  case 48: {
+    Node48* n = static_cast<Node48*>(node);
+    return n->index[byte] ? &n->children[n->index[byte] - 1] : NULL;
+  }
+  default: {
+    Node256* n = static_cast<Node256*>(node);
+    return n->children[byte].leaf ? &n->children[byte] : NULL;
+  }
+  }
+}
+
+ArtIndex::Child* ArtIndex::nextChild(Node* node, int byte)
+{
+  // find the child with the smallest key byte larger than byte
+  switch (node->type) {
+  case 4: {
+    Node4* n = static_cast<Node4*>(node);
+    for (int i = 0; i < n->count; i++) {
+      if (n->keys[i] > byte) return &n->children[i];
+    }
+    return NULL;
+  }
+  case 16: {
+    Node16* n = static_cast<Node16*>(node);
+    for (int i = 0; i < n->count; i++) {
+      if (n->keys[i] > byte) return &n->children[i];
+    }
+    return NULL;
+  }
+  case 48: {
+    Node48* n = static_cast<Node48*>(node);
+    for (int b = byte + 1; b < 256; b++) {
+      if (n->index[b]) return &n->children[n->index[b] - 1];
+    }
+    return NULL;
+  }
+  default: {
+    Node256* n = static_cast<Node256*>(node);
+    for (int b = byte + 1; b < 256; b++) {
+      if (n->children[b].leaf) return &n->children[b];
+    }
+    return NULL;
+  }
+  }
+}
+
+void ArtIndex::addChild(Node*& node, unsigned char byte, Child child)
+{
+  switch (node->type) {
+  case 4: {
+    Node4* n = static_cast<Node4*>(node);
+    if (n->count < 4) {
+      int i = n->count;
+      for (; i > 0 && n->keys[i-1] > byte; i--) {
+        n->keys[i] = n->keys[i-1];
+        n->children[i] = n->children[i-1];
+      }
+      n->keys[i] = byte;
+      n->children[i] = child;
+      n->count++;
+      return;
+    }
+    // full: grow into a Node16
+    Node16* grown = new Node16();
+    grown->type = 16;
+    grown->count = n->count;
+    memcpy(grown->keys, n->keys, sizeof(n->keys));
+    memcpy(grown->children, n->children, sizeof(n->children));
+    delete n;
+    node = grown;
+    break;
+  }
+  case 16: {
+    Node16* n = static_cast<Node16*>(node);
+    if (n->count < 16) {
+      int i = n->count;
+      for (; i > 0 && n->keys[i-1] > byte; i--) {
+        n->keys[i] = n->keys[i-1];
+        n->children[i] = n->children[i-1];
+      }
+      n->keys[i] = byte;
+      n->children[i] = child;
+      n->count++;
+      return;
+    }
+    // full: grow into a Node48
+    Node48* grown = new Node48();
+    grown->type = 48;
+    grown->count = n->count;
+    for (int i = 0; i < n->count; i++) {
+      grown->index[n->keys[i]] = i + 1;
+      grown->children[i] = n->children[i];
+    }
+    delete n;
+    node = grown;
+    break;
+  }
+  case 48: {
+    Node48* n = static_cast<Node48*>(node);
+    if (n->count < 48) {
+      n->children[n->count] = child;
+      n->index[byte] = ++n->count;
+      return;
+    }
+    // full: grow into a Node256
+    Node256* grown = new Node256();
+    grown->type = 0;
+    grown->count = n->count;
+    for (int b = 0; b < 256; b++) {
+      if (n->index[b]) grown->children[b] = n->children[n->index[b] - 1];
+    }
+    delete n;
+    node = grown;
+    break;
+  }
+  default: {
+    Node256* n = static_cast<Node256*>(node);
+    n->children[byte] = child;
+    n->count++;
+    return;
+  }
+  }
+
+  // the node was grown and now has room for the child
+  addChild(node, byte, child);
+}
+
+long ArtIndex::minimum(Child child, int depth)
+{
+  for (; depth < KEY_BYTES; depth++) {
+    child = *nextChild(child.node, -1);
+  }
+  return child.leaf;
+}
+
+long ArtIndex::lowerBound(Child child, int depth, const unsigned char bytes[KEY_BYTES])
+{
+  if (depth == KEY_BYTES) return child.leaf;
+
+  // follow the exact byte first; if nothing under it is large enough,
+  // the answer is the smallest entry under the next larger byte
+  Child* c = findChild(child.node, bytes[depth]);
+  if (c != NULL) {
+    long leaf = lowerBound(*c, depth + 1, bytes);
+    if (leaf != 0) return leaf;
+  }
+
+  c = nextChild(child.node, bytes[depth]);
+  if (c != NULL) return minimum(*c, depth + 1);
+
+  return 0;
+}
+
+void ArtIndex::destroy(Node* node, int depth)
+{
+  // below the last key byte the children are entry positions, not nodes
+  bool inner = depth < KEY_BYTES - 1;
+
+  switch (node->type) {
+  case 4: {
+    Node4* n = static_cast<Node4*>(node);
+    for (int i = 0; inner && i < n->count; i++) destroy(n->children[i].node, depth + 1);
+    delete n;
+    break;
+  }
+  case 16: {
+    Node16* n = static_cast<Node16*>(node);
+    for (int i = 0; inner && i < n->count; i++) destroy(n->children[i].node, depth + 1);
+    delete n;
+    break;
+  }
+  case 48: {
+    Node48* n = static_cast<Node48*>(node);
+    for (int i = 0; inner && i < n->count; i++) destroy(n->children[i].node, depth + 1);
+    delete n;
+    break;
+  }
+  default: {
+    Node256* n = static_cast<Node256*>(node);
+    for (int b = 0; inner && b < 256; b++) {
+      if (n->children[b].node != NULL) destroy(n->children[b].node, depth + 1);
+    }
+    delete n;
+    break;
+  }
+  }
+}
+
+RC ArtIndex::build(const vector<IndexEntry>& sorted)
+{
+  if (root != NULL) {
+    destroy(root, 0);
+    root = NULL;
+  }
+  entries = sorted;
+  if (entries.empty()) return 0;
+
+  root = new Node4();
+  root->type = 4;
+
+  unsigned char bytes[KEY_BYTES];
+  for (unsigned i = 0; i < entries.size(); i++) {
+    keyBytes(entries[i].key, bytes);
+
+    // walk down the key bytes, creating the missing inner nodes
+    Node** ref = &root;
+    for (int depth = 0; depth < KEY_BYTES; depth++) {
+      Child* c = findChild(*ref, bytes[depth]);
+      if (depth == KEY_BYTES - 1) {
+        // keep the first entry of a duplicate key
+        if (c == NULL) {
+          Child leaf;
+          leaf.leaf = (long) i + 1;
+          addChild(*ref, bytes[depth], leaf);
+        }
+        break;
+      }
+      if (c == NULL) {
+        Child inner;
+        inner.node = new Node4();
+        inner.node->type = 4;
+        addChild(*ref, bytes[depth], inner);
+        c = findChild(*ref, bytes[depth]);
+      }
+      ref = &c->node;
+    }
+  }
+
+  return 0;
+}
+
+RC ArtIndex::locate(int searchKey, IndexCursor& cursor) const
+{
+  long leaf = 0;
+  if (root != NULL) {
+    unsigned char bytes[KEY_BYTES];
+    keyBytes(searchKey, bytes);
+    Child r;
+    r.node = root;
+    leaf = lowerBound(r, 0, bytes);
+  }
+
+  if (leaf == 0) {
+    // every key is smaller than searchKey
+    cursor.pid = -1;
+    cursor.eid = entries.size();
+  } else {
+    cursor.pid = 0;
+    cursor.eid = leaf - 1;
+  }
+  return 0;
+}
+
+RC ArtIndex::locateLast(int searchKey, IndexCursor& cursor) const
+{
+  // the entry just before the first one above searchKey
+  int next = entries.size();
+  if (searchKey != std::numeric_limits<int>::max()) {
+    locate(searchKey + 1, cursor);
+    next = cursor.eid;
+  }
+
+  if (next == 0) {
+    cursor.pid = -1;
+    cursor.eid = 0;
+  } else {
+    cursor.pid = 0;
+    cursor.eid = next - 1;
+  }
+  return 0;
+}
+
+RC ArtIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid) const
+{
+  if (cursor.pid == -1 || cursor.eid < 0 || cursor.eid >= (int) entries.size()) {
+    return RC_INVALID_CURSOR;
+  }
+
+  key = entries[cursor.eid].key;
+  rid = entries[cursor.eid].rid;
+  if (++cursor.eid == (int) entries.size()) {
+    cursor.pid = -1;
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef ARTINDEX_H
+#define ARTINDEX_H
+
+#include <vector>
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+
+/**
+ * An in-memory adaptive radix tree (ART) over int keys.
+ * A key is split into its four bytes, most significant first (with the
+ * sign bit flipped so that byte order matches int order), and each byte
+ * selects a child on one level of the tree. Inner nodes come in four
+ * sizes (4, 16, 48 and 256 children) and grow as children are added, so
+ * sparse levels stay small and dense levels are a direct array lookup.
+ *
+ * The (key, rid) pairs themselves are kept in a sorted array and the
+ * tree maps a key to its position in that array. ArtIndex follows the
+ * locate()/readForward() cursor contract of BTreeIndex: cursor.eid is
+ * the position in the array and cursor.pid is -1 past the last entry.
+ */
+class ArtIndex {
+ public:
+  ArtIndex();
+  ~ArtIndex();
+
+  /**
+   * Build the tree over a sorted run of entries, replacing its content.
+   * @param entries[IN] the entries to store, in strictly ascending key order
+   * @return error code. 0 if no error
+   */
+  RC build(const std::vector<IndexEntry>& entries);
+
+  /**
+   * Find the first entry whose key is larger than or equal to searchKey.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the entry
+   * @return error code. 0 if no error
+   */
+  RC locate(int searchKey, IndexCursor& cursor) const;
+
+  /**
+   * Find the last entry whose key is smaller than or equal to searchKey.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the entry; its pid is -1
+   * if every key is larger than searchKey
+   * @return error code. 0 if no error
+   */
+  RC locateLast(int searchKey, IndexCursor& cursor) const;
+
+  /**
+   * Read the (key, rid) pair at the cursor and move the cursor forward.
+   * @param cursor[IN/OUT] the cursor pointing to an entry
+   * @param key[OUT] the key stored at the cursor location
+   * @param rid[OUT] the RecordId stored at the cursor location
+   * @return error code. 0 if no error
+   */
+  RC readForward(IndexCursor& cursor, int& key, RecordId& rid) const;
+
+  /**
+   * @return the number of entries in the tree
+   */
+  int size() const { return entries.size(); }
+
+ private:
+  struct Node;
+  struct Node4;
+  struct Node16;
+  struct Node48;
+  struct Node256;
+
+  /**
+   * A child slot. Below the last key byte the slot holds the position of
+   * an entry plus one, so that an empty slot is always zero.
+   */
+  union Child {
+    Node* node;
+    long  leaf;
+  };
+
+  static const int KEY_BYTES = 4;
+
+  static void   keyBytes(int key, unsigned char bytes[KEY_BYTES]);
+  static Child* findChild(Node* node, unsigned char byte);
+  static Child* nextChild(Node* node, int byte);
+  static void   addChild(Node*& node, unsigned char byte, Child child);
+  static long   minimum(Child child, int depth);
+  static long   lowerBound(Child child, int depth, const unsigned char bytes[KEY_BYTES]);
+  static void   destroy(Node* node, int depth);
+
+  // ArtIndex owns its nodes; copying is not supported
+  ArtIndex(const ArtIndex&);
+  ArtIndex& operator=(const ArtIndex&);
+
+  Node*                   root;     // the root node, NULL if empty
+  std::vector<IndexEntry> entries;  // the entries in ascending key order
+};
+
+#endif // ARTINDEX_H
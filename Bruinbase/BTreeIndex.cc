@@ -7,11 +7,57 @@
  * @date 3/24/2008
  */
 
+#include <algorithm>
+#include <limits>
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
 
 using namespace std;
 
+/*
+ * The layout of the meta page, as an array of ints. META_FORMAT holds
+ * FORMAT_MAGIC in every index written with entry counts in its non-leaf
+ * nodes; older index files lay their nodes out differently. The learned
+ * model fields after META_NUM_ENTRIES are only valid when META_LEARNED
+ * holds LEARNED_MAGIC.
+ */
+static const int META_ROOT_PID     = 0;
+static const int META_TREE_HEIGHT  = 1;
+static const int META_LEARNED      = 2;
+static const int META_NUM_ENTRIES  = 3;
+static const int META_NUM_SEGMENTS = 4;
+static const int META_FIRST_SEG    = 5;
+static const int META_NUM_SEG_PAGES= 6;
+static const int META_FORMAT       = 7;
+static const int META_SEG_KEYS     = 8;
+static const int META_MAX_SEG_PAGES= PageFile::PAGE_SIZE / sizeof(int) - META_SEG_KEYS;
+static const int LEARNED_MAGIC     = 0x4c524e32;
+static const int FORMAT_MAGIC      = 0x42544332;
+
+/*
+ * The number of entries bulkLoad() puts in a leaf. The rest of the leaf
+ * is left free, so the first inserts into it do not split it. The learned
+ * model maps positions to leaves with the same number; model files from
+ * when the leaves were packed full have an older LEARNED_MAGIC.
+ */
+static const int LEAF_FILL = BTLeafNode::MAX_ENTRIES * 9 / 10;
+
+/*
+ * One linear piece of the learned model: a key at or after firstKey is
+ * predicted to be at position firstPos + slope * (key - firstKey).
+ */
+struct Segment {
+    int    firstKey;
+    int    firstPos;
+    double slope;
+};
+/*
+ * A segment page holds the segment count, the first position covered by
+ * the next page (so the last segment on the page is bounded too) and
+ * then the segments themselves.
+ */
+static const int SEGMENTS_PER_PAGE = (PageFile::PAGE_SIZE - 2 * sizeof(int)) / sizeof(Segment);
+
 /*
  * BTreeIndex constructor
  */
@@ -20,6 +66,11 @@ BTreeIndex::BTreeIndex()
     rootPid    = -1;
     treeHeight =  0;
     pfMode     = 'r';
+
+    learned     = false;
+    numEntries  = 0;
+    numSegments = 0;
+    firstSegPid = -1;
 }
 
 /*
@@ -37,8 +88,23 @@ RC BTreeIndex::open(const string& indexname, char mode)
         char temp[PageFile::PAGE_SIZE];
         RC readRes = pf.read(META_PID, temp);
         if(readRes == 0){
-            memcpy(&rootPid, temp, sizeof(rootPid));
-            memcpy(&treeHeight, temp + sizeof(rootPid), sizeof(treeHeight));
+            int meta[PageFile::PAGE_SIZE / sizeof(int)];
+            memcpy(meta, temp, sizeof(meta));
+            if(meta[META_FORMAT] != FORMAT_MAGIC) {
+                pf.close();
+                return RC_INVALID_FILE_FORMAT;
+            }
+            rootPid    = meta[META_ROOT_PID];
+            treeHeight = meta[META_TREE_HEIGHT];
+            numEntries = meta[META_NUM_ENTRIES];
+
+            learned = meta[META_LEARNED] == LEARNED_MAGIC;
+            if(learned) {
+                numSegments = meta[META_NUM_SEGMENTS];
+                firstSegPid = meta[META_FIRST_SEG];
+                segPageKeys.assign(meta + META_SEG_KEYS,
+                                   meta + META_SEG_KEYS + meta[META_NUM_SEG_PAGES]);
+            }
         } else {
             return readRes;
         }
@@ -53,9 +119,22 @@ RC BTreeIndex::open(const string& indexname, char mode)
 RC BTreeIndex::close()
 {
     if(pfMode == 'w') {
+        int meta[PageFile::PAGE_SIZE / sizeof(int)];
+        memset(meta, 0, sizeof(meta));
+        meta[META_ROOT_PID]    = rootPid;
+        meta[META_TREE_HEIGHT] = treeHeight;
+        meta[META_NUM_ENTRIES] = numEntries;
+        meta[META_FORMAT]      = FORMAT_MAGIC;
+        if(learned) {
+            meta[META_LEARNED]       = LEARNED_MAGIC;
+            meta[META_NUM_SEGMENTS]  = numSegments;
+            meta[META_FIRST_SEG]     = firstSegPid;
+            meta[META_NUM_SEG_PAGES] = segPageKeys.size();
+            std::copy(segPageKeys.begin(), segPageKeys.end(), meta + META_SEG_KEYS);
+        }
+
         char temp[PageFile::PAGE_SIZE];
-        memcpy(temp, &rootPid, sizeof(rootPid));
-        memcpy(temp + sizeof(rootPid), &treeHeight, sizeof(treeHeight));
+        memcpy(temp, meta, sizeof(meta));
         RC writeRes = pf.write(META_PID,temp);
         if(writeRes != 0) return writeRes;
     }
@@ -67,7 +146,9 @@ RC BTreeIndex::insertRecursive(int             key,
                                PageId          pid,
                                int             currentHeight,
                                int&            outKey,
-                               PageId&         outPid)
+                               PageId&         outPid,
+                               int&            nodeCount,
+                               int&            outCount)
 {
     RC result;
     if(currentHeight > 1) {
@@ -77,32 +158,40 @@ RC BTreeIndex::insertRecursive(int             key,
             return result;
         }
 
-        PageId childPid;
-
-        result = node.locateChildPtr(key, childPid);
+        int childIndex;
+        result = node.locateChildIndex(key, childIndex);
         if(result != 0) {
             // This should never happen
             return result;
         }
+        PageId childPid = node.getChildPtr(childIndex);
 
         int    possibleKey = -1;
         PageId possiblePid = -1;
+        int    childCount;
+        int    possibleCount = 0;
         result = insertRecursive(key,
                                  rid,
                                  childPid,
                                  currentHeight-1,
                                  possibleKey,
-                                 possiblePid);
+                                 possiblePid,
+                                 childCount,
+                                 possibleCount);
         if(result != 0) {
             return result;
         }
 
+        // The child gained an entry, or gave some of them away to the
+        // sibling it split off
+        node.setEntryCount(childIndex, childCount);
+
         if(possibleKey != -1 && possiblePid != -1) {
-            result = node.insert(possibleKey, possiblePid);
+            result = node.insert(possibleKey, possiblePid, possibleCount);
             if(result != 0) {
                 BTNonLeafNode sibling;
                 int midKey;
-                result = node.insertAndSplit(possibleKey, possiblePid, sibling, midKey);
+                result = node.insertAndSplit(possibleKey, possiblePid, sibling, midKey, possibleCount);
                 if(result != 0) {
                     return result;
                 }
@@ -114,10 +203,12 @@ RC BTreeIndex::insertRecursive(int             key,
                     return result;
                 }
 
-                outKey = midKey;
-                outPid = siblingPid;
+                outKey   = midKey;
+                outPid   = siblingPid;
+                outCount = sibling.getTotalEntryCount();
             }
         }
+        nodeCount = node.getTotalEntryCount();
         return node.write(pid, pf);
     } else if(currentHeight == 1) {
         BTLeafNode leaf;
@@ -156,10 +247,12 @@ RC BTreeIndex::insertRecursive(int             key,
                 return result;
             }
 
-            outKey = siblingKey;
-            outPid = siblingPid;
+            outKey   = siblingKey;
+            outPid   = siblingPid;
+            outCount = sibling.getKeyCount();
         }
 
+        nodeCount = leaf.getKeyCount();
         return leaf.write(pid, pf);
     }
 
@@ -175,6 +268,12 @@ RC BTreeIndex::insertRecursive(int             key,
 RC BTreeIndex::insert(int key, const RecordId& rid)
 {
     RC result;
+
+    // An insert may split a leaf, after which the positions predicted by
+    // the learned model no longer match the pages. Fall back to the tree.
+    learned = false;
+    numEntries++;
+
     if(treeHeight == 0) {
         // Must create a leaf node
         BTLeafNode root;
@@ -190,19 +289,23 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     } else {
         int    possibleKey = -1;
         PageId possiblePid = -1;
+        int    rootCount;
+        int    possibleCount = 0;
         result = insertRecursive(key,
                                  rid,
                                  rootPid,
                                  treeHeight,
                                  possibleKey,
-                                 possiblePid);
+                                 possiblePid,
+                                 rootCount,
+                                 possibleCount);
         if(result != 0) {
             return result;
         }
 
         if(possibleKey != -1 && possiblePid != -1) {
             BTNonLeafNode newRoot;
-            result = newRoot.initializeRoot(rootPid, possibleKey, possiblePid);
+            result = newRoot.initializeRoot(rootPid, possibleKey, possiblePid, rootCount, possibleCount);
             if(result != 0) return result;
 
             PageId newRootPid = pf.endPid();
@@ -244,6 +347,10 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
         return -1;
     }
 
+    if(learned) {
+        return locateLearned(searchKey, cursor);
+    }
+
     int currentPid = rootPid;
     int height;
     for(height = treeHeight; height > 1; height--) {
@@ -260,13 +367,18 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
         }
     }
 
+    return locateInLeaf(currentPid, searchKey, cursor);
+}
+
+RC BTreeIndex::locateInLeaf(PageId pid, int searchKey, IndexCursor& cursor)
+{
     BTLeafNode node;
-    int result = node.read(currentPid, pf);
+    int result = node.read(pid, pf);
     if(result != 0) {
         return result;
     }
 
-    cursor.pid = currentPid;
+    cursor.pid = pid;
     result = node.locate(searchKey, cursor.eid);
     if(result != 0) {
         // It's quite possible that we may never find an
@@ -285,6 +397,52 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
     return 0;
 }
 
+/*
+ * Find the last leaf-node index entry whose key value is smaller than or
+ * equal to searchKey, with a single descent from the root.
+ * Every leaf but the leftmost starts with the separator key that leads
+ * to it, which is not larger than searchKey, so the leaf the descent
+ * ends in holds the entry unless no key in the tree is small enough.
+ * @param searchKey[IN] the key to find.
+ * @param cursor[OUT] the cursor pointing to the entry; its pid is -1
+ *                    if every key is larger than searchKey.
+ * @return error code. 0 if no error.
+ */
+RC BTreeIndex::locateLast(int searchKey, IndexCursor& cursor)
+{
+    cursor.pid = -1;
+    cursor.eid = 0;
+    if(treeHeight == 0) {
+        return 0;
+    }
+
+    PageId pid = rootPid;
+    RC     result;
+    for(int height = treeHeight; height > 1; height--) {
+        BTNonLeafNode node;
+        result = node.read(pid, pf);
+        if(result != 0) return result;
+
+        result = node.locateChildPtr(searchKey, pid);
+        if(result != 0) return result;
+    }
+
+    BTLeafNode leaf;
+    result = leaf.read(pid, pf);
+    if(result != 0) return result;
+
+    // The entry just before the first one above searchKey
+    int eid;
+    if(searchKey == std::numeric_limits<int>::max() || leaf.locate(searchKey + 1, eid) != 0) {
+        eid = leaf.getKeyCount();
+    }
+    if(eid > 0) {
+        cursor.pid = pid;
+        cursor.eid = eid - 1;
+    }
+    return 0;
+}
+
 /*
  * Read the (key, rid) pair at the location specified by the index cursor,
  * and move foward the cursor to the next entry.
@@ -309,3 +467,463 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
     }
     return readEntryRes;
 }
+
+RC BTreeIndex::locateBatchRecursive(const vector<int>& keys,
+                                    int                begin,
+                                    int                end,
+                                    PageId             pid,
+                                    int                currentHeight,
+                                    vector<IndexEntry>& entries)
+{
+    RC result;
+    if(currentHeight > 1) {
+        BTNonLeafNode node;
+        result = node.read(pid, pf);
+        if(result != 0) {
+            return result;
+        }
+
+        // The keys are sorted, so all the keys routed to the same child
+        // form a contiguous run. Find each run and descend once for it.
+        int runBegin = begin;
+        while(runBegin < end) {
+            PageId childPid;
+            result = node.locateChildPtr(keys[runBegin], childPid);
+            if(result != 0) {
+                return result;
+            }
+
+            int runEnd = runBegin + 1;
+            while(runEnd < end) {
+                PageId nextPid;
+                result = node.locateChildPtr(keys[runEnd], nextPid);
+                if(result != 0) {
+                    return result;
+                }
+                if(nextPid != childPid) break;
+                runEnd++;
+            }
+
+            result = locateBatchRecursive(keys,
+                                          runBegin,
+                                          runEnd,
+                                          childPid,
+                                          currentHeight-1,
+                                          entries);
+            if(result != 0) {
+                return result;
+            }
+            runBegin = runEnd;
+        }
+        return 0;
+    } else if(currentHeight == 1) {
+        BTLeafNode leaf;
+        result = leaf.read(pid, pf);
+        if(result != 0) {
+            return result;
+        }
+
+        // Merge the sorted keys against the sorted leaf entries. The entry
+        // position only moves forward, so the leaf is swept exactly once.
+        const int numKeys = leaf.getKeyCount();
+        int      eid = 0;
+        int      key;
+        RecordId rid;
+        for(int i = begin; i < end; i++) {
+            while(eid < numKeys) {
+                leaf.readEntry(eid, key, rid);
+                if(key >= keys[i]) break;
+                eid++;
+            }
+            if(eid == numKeys) {
+                // Every remaining key is larger than anything in the leaf
+                break;
+            }
+            if(key == keys[i]) {
+                IndexEntry entry = {key, rid};
+                entries.push_back(entry);
+            }
+        }
+        return 0;
+    }
+
+    return -1234;
+}
+
+/*
+ * Look up a batch of keys with a single traversal of the tree.
+ * @param keys[IN] the keys to look up, sorted in ascending order
+ * @param entries[OUT] the (key, rid) pairs found, in ascending key order
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::locateBatch(const vector<int>& keys, vector<IndexEntry>& entries)
+{
+    entries.clear();
+    if(treeHeight == 0 || keys.empty()) {
+        // Nothing can match in an empty tree
+        return 0;
+    }
+
+    return locateBatchRecursive(keys, 0, keys.size(), rootPid, treeHeight, entries);
+}
+
+/*
+ * Read every (key, rid) pair in the index by walking the leaf chain.
+ * @param entries[OUT] all entries in the index, in ascending key order
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readAll(vector<IndexEntry>& entries)
+{
+    entries.clear();
+    if(treeHeight == 0) {
+        return 0;
+    }
+
+    // Walk down the leftmost pointers to the first leaf
+    PageId pid = rootPid;
+    for(int height = treeHeight; height > 1; height--) {
+        BTNonLeafNode node;
+        RC result = node.read(pid, pf);
+        if(result != 0) {
+            return result;
+        }
+        result = node.locateChildPtr(std::numeric_limits<int>::min(), pid);
+        if(result != 0) {
+            return result;
+        }
+    }
+
+    while(pid != -1) {
+        BTLeafNode leaf;
+        RC result = leaf.read(pid, pf);
+        if(result != 0) {
+            return result;
+        }
+        const int numKeys = leaf.getKeyCount();
+        for(int eid = 0; eid < numKeys; eid++) {
+            IndexEntry entry;
+            leaf.readEntry(eid, entry.key, entry.rid);
+            entries.push_back(entry);
+        }
+        pid = leaf.getNextNodePtr();
+    }
+
+    return 0;
+}
+
+/*
+ * Build the whole tree bottom-up from a sorted run of entries.
+ * @param entries[IN] the entries to store, in strictly ascending key order
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::bulkLoad(const vector<IndexEntry>& entries)
+{
+    if(treeHeight != 0 || pf.endPid() > META_PID + 1) {
+        // We only build into an empty index
+        return -1;
+    }
+    if(entries.empty()) {
+        return 0;
+    }
+
+    RC result;
+
+    // The first key, the pid and the entry count of every node on the
+    // level being built. The first key of a child is the separator its
+    // parent stores for it.
+    vector<int>    levelKeys;
+    vector<PageId> levelPids;
+    vector<int>    levelCounts;
+
+    // Fill the leaves and chain them together in page order
+    const int numLeaves = (entries.size() + LEAF_FILL - 1) / LEAF_FILL;
+    PageId pid = META_PID + 1;
+    for(int i = 0; i < numLeaves; i++, pid++) {
+        BTLeafNode leaf;
+        const int first = i * LEAF_FILL;
+        const int last  = std::min<int>(first + LEAF_FILL, entries.size());
+        for(int j = first; j < last; j++) {
+            result = leaf.insert(entries[j].key, entries[j].rid);
+            if(result != 0) return result;
+        }
+        leaf.setNextNodePtr(i + 1 < numLeaves ? pid + 1 : -1);
+        result = leaf.write(pid, pf);
+        if(result != 0) return result;
+
+        levelKeys.push_back(entries[first].key);
+        levelPids.push_back(pid);
+        levelCounts.push_back(last - first);
+    }
+    treeHeight = 1;
+    numEntries = entries.size();
+
+    // Build the non-leaf levels until a single node is left. The children
+    // are spread evenly, so every node gets at least two of them.
+    while(levelPids.size() > 1) {
+        vector<int>    parentKeys;
+        vector<PageId> parentPids;
+        vector<int>    parentCounts;
+
+        const int numChildren = levelPids.size();
+        const int numNodes    = (numChildren + BTNonLeafNode::MAX_PAGES - 1) / BTNonLeafNode::MAX_PAGES;
+        int child = 0;
+        for(int i = 0; i < numNodes; i++, pid++) {
+            const int size = numChildren / numNodes + (i < numChildren % numNodes ? 1 : 0);
+
+            BTNonLeafNode node;
+            result = node.initializeRoot(levelPids[child], levelKeys[child+1], levelPids[child+1],
+                                         levelCounts[child], levelCounts[child+1]);
+            if(result != 0) return result;
+            for(int j = child + 2; j < child + size; j++) {
+                result = node.insert(levelKeys[j], levelPids[j], levelCounts[j]);
+                if(result != 0) return result;
+            }
+            result = node.write(pid, pf);
+            if(result != 0) return result;
+
+            parentKeys.push_back(levelKeys[child]);
+            parentPids.push_back(pid);
+            parentCounts.push_back(node.getTotalEntryCount());
+            child += size;
+        }
+
+        levelKeys.swap(parentKeys);
+        levelPids.swap(parentPids);
+        levelCounts.swap(parentCounts);
+        treeHeight++;
+    }
+    rootPid = levelPids[0];
+
+    return 0;
+}
+
+/*
+ * Count the entries whose keys are in [minKey, maxKey].
+ * @param minKey[IN] the smallest key in the range
+ * @param maxKey[IN] the largest key in the range
+ * @param count[OUT] the number of entries in the range
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::countRange(int minKey, int maxKey, int& count)
+{
+    count = 0;
+    if(minKey > maxKey || treeHeight == 0) {
+        return 0;
+    }
+
+    // The entries below minKey and the entries up to maxKey. An open end
+    // of the range needs no descent.
+    int below = 0;
+    int upTo  = numEntries;
+    RC  result;
+    if(minKey != std::numeric_limits<int>::min()) {
+        result = rank(minKey, below);
+        if(result != 0) return result;
+    }
+    if(maxKey != std::numeric_limits<int>::max()) {
+        result = rank(maxKey + 1, upTo);
+        if(result != 0) return result;
+    }
+
+    count = upTo - below;
+    return 0;
+}
+
+/*
+ * Count the entries whose keys are below searchKey, by adding up the
+ * entry counts of the children left of the path to searchKey.
+ * @param searchKey[IN] the key to rank
+ * @param count[OUT] the number of entries with keys below searchKey
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::rank(int searchKey, int& count)
+{
+    RC result;
+
+    count = 0;
+    PageId pid = rootPid;
+    for(int height = treeHeight; height > 1; height--) {
+        BTNonLeafNode node;
+        result = node.read(pid, pf);
+        if(result != 0) return result;
+
+        int index;
+        result = node.locateChildIndex(searchKey, index);
+        if(result != 0) return result;
+        for(int i = 0; i < index; i++) {
+            count += node.getEntryCount(i);
+        }
+        pid = node.getChildPtr(index);
+    }
+
+    BTLeafNode leaf;
+    result = leaf.read(pid, pf);
+    if(result != 0) return result;
+
+    int eid;
+    if(leaf.locate(searchKey, eid) != 0) {
+        // Every key in the leaf is below searchKey
+        eid = leaf.getKeyCount();
+    }
+    count += eid;
+    return 0;
+}
+
+/*
+ * Bulk-load the tree like bulkLoad() and also fit a learned model over
+ * the leaf level.
+ * @param entries[IN] the entries to store, in strictly ascending key order
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::bulkLoadLearned(const vector<IndexEntry>& entries)
+{
+    RC result = bulkLoad(entries);
+    if(result != 0 || entries.empty()) {
+        return result;
+    }
+
+    // The segments go after the last node of the tree
+    return writeSegments(entries, pf.endPid());
+}
+
+RC BTreeIndex::writeSegments(const vector<IndexEntry>& entries, PageId firstPid)
+{
+    // Fit the segments greedily with a shrinking cone: keep the range of
+    // slopes that predicts every point seen so far within LEARNED_EPSILON,
+    // and start a new segment when the range becomes empty.
+    vector<Segment> segments;
+    const int n = entries.size();
+    int start = 0;
+    while(start < n) {
+        const double x0 = entries[start].key;
+        double lo = 0;
+        double hi = std::numeric_limits<double>::max();
+        int end = start + 1;
+        for(; end < n; end++) {
+            const double dx = entries[end].key - x0;
+            if(dx <= 0) break;
+            const double dy = end - start;
+            const double newLo = std::max(lo, (dy - LEARNED_EPSILON) / dx);
+            const double newHi = std::min(hi, (dy + LEARNED_EPSILON) / dx);
+            if(newLo > newHi) break;
+            lo = newLo;
+            hi = newHi;
+        }
+
+        Segment segment;
+        segment.firstKey = entries[start].key;
+        segment.firstPos = start;
+        segment.slope    = (end - start == 1) ? 0 : (lo + hi) / 2;
+        segments.push_back(segment);
+        start = end;
+    }
+
+    const int numPages = (segments.size() + SEGMENTS_PER_PAGE - 1) / SEGMENTS_PER_PAGE;
+    if(numPages > META_MAX_SEG_PAGES) {
+        // The directory would not fit on the meta page. Keep the plain tree.
+        return 0;
+    }
+
+    segPageKeys.clear();
+    for(int i = 0; i < numPages; i++) {
+        char page[PageFile::PAGE_SIZE];
+        memset(page, 0, sizeof(page));
+
+        const int first   = i * SEGMENTS_PER_PAGE;
+        const int count   = std::min<int>(SEGMENTS_PER_PAGE, segments.size() - first);
+        const int nextPos = (first + count < (int) segments.size())
+                            ? segments[first + count].firstPos : n;
+        memcpy(page, &count, sizeof(count));
+        memcpy(page + sizeof(count), &nextPos, sizeof(nextPos));
+        memcpy(page + 2 * sizeof(int), &segments[first], count * sizeof(Segment));
+
+        RC result = pf.write(firstPid + i, page);
+        if(result != 0) return result;
+        segPageKeys.push_back(segments[first].firstKey);
+    }
+
+    learned     = true;
+    numEntries  = n;
+    numSegments = segments.size();
+    firstSegPid = firstPid;
+    return 0;
+}
+
+RC BTreeIndex::locateLearned(int searchKey, IndexCursor& cursor)
+{
+    // Pick the segment page from the in-memory directory
+    int pageIndex = std::upper_bound(segPageKeys.begin(), segPageKeys.end(), searchKey)
+                    - segPageKeys.begin() - 1;
+    if(pageIndex < 0) {
+        // Smaller than every key: the first entry is the answer
+        cursor.pid = META_PID + 1;
+        cursor.eid = 0;
+        return 0;
+    }
+
+    char page[PageFile::PAGE_SIZE];
+    RC result = pf.read(firstSegPid + pageIndex, page);
+    if(result != 0) {
+        return result;
+    }
+    int count, pageNextPos;
+    memcpy(&count, page, sizeof(count));
+    memcpy(&pageNextPos, page + sizeof(count), sizeof(pageNextPos));
+    Segment segments[SEGMENTS_PER_PAGE];
+    memcpy(segments, page + 2 * sizeof(int), count * sizeof(Segment));
+
+    // Find the last segment starting at or before the key
+    int lo = 0, hi = count - 1;
+    while(lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if(segments[mid].firstKey <= searchKey) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    const Segment& segment = segments[lo];
+
+    // The first position of the next segment bounds this one
+    const int nextPos = (lo + 1 < count) ? segments[lo + 1].firstPos : pageNextPos;
+
+    double predicted = segment.firstPos + segment.slope * ((double) searchKey - segment.firstKey);
+    if(predicted < segment.firstPos) predicted = segment.firstPos;
+    if(predicted > nextPos) predicted = nextPos;
+
+    // The entry is within epsilon of the prediction (plus one for rounding
+    // and for keys that fall between two stored keys).
+    int first = (int) predicted - LEARNED_EPSILON - 1;
+    int last  = (int) predicted + LEARNED_EPSILON + 1;
+    if(first < 0) first = 0;
+    if(last > numEntries - 1) last = numEntries - 1;
+
+    // The window is narrower than a leaf, so it spans at most two leaves.
+    // Start with the leaf holding the predicted position and only read
+    // its neighbour in the window when the entry is not in it.
+    PageId firstLeaf = META_PID + 1 + first / LEAF_FILL;
+    PageId lastLeaf  = META_PID + 1 + last  / LEAF_FILL;
+    PageId pid       = META_PID + 1 + std::min((int) predicted, last) / LEAF_FILL;
+    result = locateInLeaf(pid, searchKey, cursor);
+    if(result != 0) {
+        return result;
+    }
+
+    if(cursor.pid == pid && cursor.eid == 0 && pid > firstLeaf) {
+        // Every key in this leaf is >= searchKey, so the entry may be
+        // at the end of the previous leaf
+        IndexCursor previous;
+        result = locateInLeaf(pid - 1, searchKey, previous);
+        if(result != 0) {
+            return result;
+        }
+        if(previous.pid == pid - 1) {
+            cursor = previous;
+        }
+    } else if(cursor.pid != pid && pid < lastLeaf) {
+        // Every key in this leaf is < searchKey, so look in the next one
+        result = locateInLeaf(pid + 1, searchKey, cursor);
+    }
+
+    return result;
+}
@@ -10,6 +10,7 @@
 #ifndef BTREEINDEX_H
 #define BTREEINDEX_H
 
+#include <vector>
 #include "Bruinbase.h"
 #include "PageFile.h"
 #include "RecordFile.h"
@@ -27,6 +28,17 @@ typedef struct {
   int     eid;
 } IndexCursor;
 
+/**
+ * A (key, rid) pair stored in a b+tree leaf node.
+ * IndexEntry is used to return the results of a batched lookup.
+ */
+typedef struct {
+  // the key of the index entry
+  int      key;
+  // the RecordId of the index entry
+  RecordId rid;
+} IndexEntry;
+
 /**
  * Implements a B-Tree index for bruinbase.
  *
@@ -40,9 +52,11 @@ class BTreeIndex {
   /**
    * Open the index file in read or write mode.
    * Under 'w' mode, the index file should be created if it does not exist.
+   * An index file written in an older layout is not opened.
    * @param indexname[IN] the name of the index file
    * @param mode[IN] 'r' for read, 'w' for write
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error, RC_INVALID_FILE_FORMAT if the
+   *         index file has an older layout
    */
   RC open(const std::string& indexname, char mode);
 
@@ -82,6 +96,16 @@ class BTreeIndex {
    */
   RC locate(int searchKey, IndexCursor& cursor);
 
+  /**
+   * Find the last leaf-node index entry whose key value is smaller than
+   * or equal to searchKey, with a single descent from the root.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the entry; its pid is -1
+   * if every key is larger than searchKey
+   * @return error code. 0 if no error
+   */
+  RC locateLast(int searchKey, IndexCursor& cursor);
+
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
    * and move forward the cursor to the next entry.
@@ -92,13 +116,113 @@ class BTreeIndex {
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
 
+  /**
+   * Look up a batch of keys with a single traversal of the tree.
+   * The keys are partitioned among the children of every non-leaf node
+   * on the way down, so each node is read at most once per batch no
+   * matter how many keys are routed through it, and keys that land in
+   * the same leaf node are matched with one sweep over its entries.
+   * Keys that are not in the index are simply absent from the output.
+   * @param keys[IN] the keys to look up, sorted in ascending order
+   * @param entries[OUT] the (key, rid) pairs found, in ascending key order
+   * @return error code. 0 if no error
+   */
+  RC locateBatch(const std::vector<int>& keys, std::vector<IndexEntry>& entries);
+
+  /**
+   * Read every (key, rid) pair in the index by walking the leaf chain.
+   * @param entries[OUT] all entries in the index, in ascending key order
+   * @return error code. 0 if no error
+   */
+  RC readAll(std::vector<IndexEntry>& entries);
+
+  /**
+   * Build the whole tree bottom-up from a sorted run of entries.
+   * The index must be open in 'w' mode on an empty file.
+   * The leaf nodes are written first, 90% full and at consecutive
+   * page ids in key order, so that following getNextNodePtr() reads the
+   * file sequentially. The non-leaf nodes are then written one level at
+   * a time above them, with the root last.
+   * @param entries[IN] the entries to store, in strictly ascending key order
+   * @return error code. 0 if no error
+   */
+  RC bulkLoad(const std::vector<IndexEntry>& entries);
+
+  /**
+   * Bulk-load the tree like bulkLoad() and also fit a learned model over
+   * the leaf level. Because every leaf but the last holds the same
+   * number of entries and the leaves are contiguous, the position of an
+   * entry in key order directly gives its leaf page and slot. The model is a list of linear segments, each predicting
+   * the position of a key within +/- epsilon entries. locate() then
+   * reads one segment page and at most two leaves instead of descending
+   * through the non-leaf levels, which are kept only as a fallback.
+   * Any later insert() turns the model off, since it moves entries.
+   * If the segments do not fit in the directory on the meta page, the
+   * index is built as a plain B+tree.
+   * @param entries[IN] the entries to store, in strictly ascending key order
+   * @return error code. 0 if no error
+   */
+  RC bulkLoadLearned(const std::vector<IndexEntry>& entries);
+
+  /**
+   * @return true if locate() is served by the learned model
+   */
+  bool isLearned() const { return learned; }
+
+  /**
+   * Count the entries whose keys are in [minKey, maxKey].
+   * Every non-leaf node keeps the number of leaf entries under each of
+   * its children, so the count is the difference of two ranks, each
+   * found with a single root-to-leaf descent. The count of the whole
+   * tree is kept on the meta page and needs no descent at all.
+   * @param minKey[IN] the smallest key in the range
+   * @param maxKey[IN] the largest key in the range
+   * @param count[OUT] the number of entries in the range
+   * @return error code. 0 if no error
+   */
+  RC countRange(int minKey, int maxKey, int& count);
+
+  /**
+   * @return the number of entries in the index
+   */
+  int getEntryCount() const { return numEntries; }
+
+  /**
+   * @return the number of levels in the tree
+   */
+  int getTreeHeight() const { return treeHeight; }
+
+  /**
+   * @return the number of pages in the index file
+   */
+  int getPageCount() const { return pf.endPid(); }
+
+  /// the maximum prediction error (in entries) of a learned segment
+  static const int LEARNED_EPSILON = 32;
+
  private:
+  RC rank(int searchKey, int& count);
+
+  RC locateLearned(int searchKey, IndexCursor& cursor);
+  RC writeSegments(const std::vector<IndexEntry>& entries, PageId firstPid);
+
+  RC locateInLeaf(PageId pid, int searchKey, IndexCursor& cursor);
+
+  RC locateBatchRecursive(const std::vector<int>& keys,
+                          int                     begin,
+                          int                     end,
+                          PageId                  pid,
+                          int                     currentHeight,
+                          std::vector<IndexEntry>& entries);
+
   RC insertRecursive(int             key,
                      const RecordId& rid,
                      PageId          pid,
                      int             currentHeight,
                      int&            outKey,
-                     PageId&         outPid);
+                     PageId&         outPid,
+                     int&            nodeCount,
+                     int&            outCount);
 
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
 
@@ -109,6 +233,15 @@ class BTreeIndex {
   /// variables in disk, so that they can be reconstructed when the index
   /// is opened again later.
   char      pfMode;
+
+  /// The learned model is also kept in the meta page. Its segments are
+  /// stored in segment pages after the tree, and the first key of every
+  /// segment page is kept in memory to pick the page to read.
+  bool             learned;     /// true if locate() uses the learned model
+  int              numEntries;  /// the number of entries in the leaves
+  int              numSegments; /// the number of segments in the model
+  PageId           firstSegPid; /// the PageId of the first segment page
+  std::vector<int> segPageKeys; /// the first key of every segment page
 };
 
 #endif /* BTREEINDEX_H */
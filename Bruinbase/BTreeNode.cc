@@ -238,6 +238,7 @@ BTNonLeafNode::BTNonLeafNode() {
     // "invalid" and can be overwritten only by initializeRoot.
     buff.nodeData.keyCount = 0;
     buff.nodeData.pageEntries[0] = -1;
+    buff.nodeData.entryCounts[0] = 0;
     /*for(int i = 0; i < MAX_ENTRIES; i++){
         buff.nodeData.entries[i].rid.pid = -1;
         buff.nodeData.entries[i].rid.sid = -1;
@@ -283,9 +284,10 @@ int BTNonLeafNode::getKeyCount()
  * Insert a (key, pid) pair to the node.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param count[IN] the number of leaf entries in the subtree under pid
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+RC BTNonLeafNode::insert(int key, PageId pid, int count)
 {
     if(getKeyCount() >= MAX_KEYS) {
         return -1;
@@ -308,6 +310,7 @@ RC BTNonLeafNode::insert(int key, PageId pid)
                 // will have an index of i. This will work out since
                 // the number of pages is one plus the number of keys
                 buff.nodeData.pageEntries[i+1] = buff.nodeData.pageEntries[i];
+                buff.nodeData.entryCounts[i+1] = buff.nodeData.entryCounts[i];
             }
         } else {
             eid = numKeys;
@@ -316,6 +319,7 @@ RC BTNonLeafNode::insert(int key, PageId pid)
         // Actually place the value
         buff.nodeData.keyEntries [eid  ] = key;
         buff.nodeData.pageEntries[eid+1] = pid;
+        buff.nodeData.entryCounts[eid+1] = count;
 
         buff.nodeData.keyCount++;
 
@@ -331,9 +335,10 @@ RC BTNonLeafNode::insert(int key, PageId pid)
  * @param pid[IN] the PageId to insert
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @param count[IN] the number of leaf entries in the subtree under pid
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey, int count)
 {
    // Just some error checking
     if(getKeyCount() != MAX_KEYS) {
@@ -363,6 +368,7 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
         // Importantly, we need the midkey's right ptr to become the
         // left-most ptr of the sibling
         sibling.buff.nodeData.pageEntries[0] = buff.nodeData.pageEntries[half+1];
+        sibling.buff.nodeData.entryCounts[0] = buff.nodeData.entryCounts[half+1];
         
         bool found = false;
         int i = half + 1, j = 0;
@@ -372,6 +378,7 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
                 // Insert the new key right here
                 sibling.buff.nodeData.keyEntries [j  ] = key;
                 sibling.buff.nodeData.pageEntries[j+1] = pid;
+                sibling.buff.nodeData.entryCounts[j+1] = count;
 
                 // Flag us for the future
                 found = true;
@@ -379,6 +386,7 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
                 // Just do a normal data copy
                 sibling.buff.nodeData.keyEntries [j  ] = buff.nodeData.keyEntries [i  ];
                 sibling.buff.nodeData.pageEntries[j+1] = buff.nodeData.pageEntries[i+1];
+                sibling.buff.nodeData.entryCounts[j+1] = buff.nodeData.entryCounts[i+1];
 
                 i++;
             }
@@ -388,6 +396,7 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
             // We need to insert the entry at the end:
             sibling.buff.nodeData.keyEntries [j  ] = key;
             sibling.buff.nodeData.pageEntries[j+1] = pid;
+            sibling.buff.nodeData.entryCounts[j+1] = count;
         }
 
         // Now we must set the appropriate keyCount
@@ -400,12 +409,13 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
         // NOTE that we are copying a total of 1 MORE page entry than key entries!
         memcpy(sibling.buff.nodeData.keyEntries , buff.nodeData.keyEntries+half+1, sizeof(buff.nodeData.keyEntries[0])*(MAX_KEYS-(half+1)));
         memcpy(sibling.buff.nodeData.pageEntries, buff.nodeData.pageEntries+half+1, sizeof(buff.nodeData.pageEntries[0])*(MAX_PAGES-(half+1)));
+        memcpy(sibling.buff.nodeData.entryCounts, buff.nodeData.entryCounts+half+1, sizeof(buff.nodeData.entryCounts[0])*(MAX_PAGES-(half+1)));
         sibling.buff.nodeData.keyCount = MAX_KEYS - (half+1);
 
         // Now we can just call our insert routine to insert
         // the proper values. Remember that keyCount was fixed above,
         // so insert knows what to do
-        int status = insert(key, pid);
+        int status = insert(key, pid, count);
         if(status != 0) return status;
     }
 
@@ -446,13 +456,10 @@ RC BTNonLeafNode::locate(int searchKey, int& eid)
  */
 RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
 {
-    int eid;
-    int status = locate(searchKey, eid);
-    int pentry = eid;
+    int pentry;
+    int status = locateChildIndex(searchKey, pentry);
     if(status != 0) {
-        pentry = getKeyCount();
-    } else if(buff.nodeData.keyEntries[eid] == searchKey) {
-        pentry = eid + 1;
+        return status;
     }
 
     // Now find the appropriate pid. We will need that
@@ -466,14 +473,80 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
     return 0;
 }
 
+/*
+ * Given the searchKey, find the position of the child-node pointer to
+ * follow and output it in index.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param index[OUT] the position of the child-node pointer to follow.
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::locateChildIndex(int searchKey, int& index)
+{
+    int eid;
+    int status = locate(searchKey, eid);
+    if(status != 0) {
+        index = getKeyCount();
+    } else if(buff.nodeData.keyEntries[eid] == searchKey) {
+        index = eid + 1;
+    } else {
+        index = eid;
+    }
+    return 0;
+}
+
+/*
+ * Return the child-node pointer at a position in the node.
+ * @param index[IN] the position of the pointer
+ * @return the PageId of the child node
+ */
+PageId BTNonLeafNode::getChildPtr(int index)
+{
+    return buff.nodeData.pageEntries[index];
+}
+
+/*
+ * Return the number of leaf entries in the subtree under a child.
+ * @param index[IN] the position of the child
+ * @return the number of leaf entries under the child
+ */
+int BTNonLeafNode::getEntryCount(int index)
+{
+    return buff.nodeData.entryCounts[index];
+}
+
+/*
+ * Set the number of leaf entries in the subtree under a child.
+ * @param index[IN] the position of the child
+ * @param count[IN] the number of leaf entries under the child
+ */
+void BTNonLeafNode::setEntryCount(int index, int count)
+{
+    buff.nodeData.entryCounts[index] = count;
+}
+
+/*
+ * Return the number of leaf entries in the subtree under this node.
+ * @return the sum of the entry counts of all children
+ */
+int BTNonLeafNode::getTotalEntryCount()
+{
+    int total = 0;
+    for(int i = 0; i <= getKeyCount(); i++) {
+        total += buff.nodeData.entryCounts[i];
+    }
+    return total;
+}
+
 /*
  * Initialize the root node with (pid1, key, pid2).
  * @param pid1[IN] the first PageId to insert
  * @param key[IN] the key that should be inserted between the two PageIds
  * @param pid2[IN] the PageId to insert behind the key
+ * @param count1[IN] the number of leaf entries under pid1
+ * @param count2[IN] the number of leaf entries under pid2
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2, int count1, int count2)
 {
     // Ensure that we truly are empty
     if(getKeyCount() != 0) {
@@ -483,6 +556,8 @@ RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
     buff.nodeData.pageEntries[0] = pid1;
     buff.nodeData.keyEntries [0] = key;
     buff.nodeData.pageEntries[1] = pid2;
+    buff.nodeData.entryCounts[0] = count1;
+    buff.nodeData.entryCounts[1] = count2;
     buff.nodeData.keyCount       = 1;
 
     return 0;
@@ -18,6 +18,8 @@
  */
 class BTLeafNode {
   public:
+    // the maximum number of (key, rid) pairs a leaf node can hold
+    const static int MAX_ENTRIES = 84;
 
     BTLeafNode();
 
@@ -101,9 +103,6 @@ class BTLeafNode {
 
   // TODO: comment out 'private'
   private:
-    // TODO: Ensure that size of structure is appropriate
-    const static int MAX_ENTRIES = 84;
-
    /**
     * The main memory buffer for loading the content of the disk page
     * that contains the node.
@@ -133,6 +132,10 @@ class BTLeafNode {
  */
 class BTNonLeafNode {
   public:
+    // Let x=MAX_KEYS. 4x + 4(x+1) + 4(x+1) + 4 <= 1024
+    const static int MAX_KEYS = 84;
+    const static int MAX_PAGES = MAX_KEYS + 1;
+
     BTNonLeafNode();
 
    /**
@@ -140,9 +143,10 @@ class BTNonLeafNode {
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param count[IN] the number of leaf entries in the subtree under pid
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(int key, PageId pid, int count = 0);
 
    /**
     * Insert the (key, pid) pair to the node
@@ -154,9 +158,10 @@ class BTNonLeafNode {
     * @param pid[IN] the PageId to insert
     * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+    * @param count[IN] the number of leaf entries in the subtree under pid
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey, int count = 0);
 
    /**
     * ******************* ADDED ********************
@@ -180,14 +185,54 @@ class BTNonLeafNode {
     */
     RC locateChildPtr(int searchKey, PageId& pid);
 
+   /**
+    * Given the searchKey, find the child-node pointer to follow like
+    * locateChildPtr(), and output its position in the node instead.
+    * The children before that position hold exactly the keys below
+    * searchKey that are under this node.
+    * @param searchKey[IN] the searchKey that is being looked up.
+    * @param index[OUT] the position of the child-node pointer to follow.
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC locateChildIndex(int searchKey, int& index);
+
+   /**
+    * Return the child-node pointer at a position in the node.
+    * @param index[IN] the position of the pointer (0 to getKeyCount())
+    * @return the PageId of the child node
+    */
+    PageId getChildPtr(int index);
+
+   /**
+    * Return the number of leaf entries in the subtree under a child.
+    * @param index[IN] the position of the child (0 to getKeyCount())
+    * @return the number of leaf entries under the child
+    */
+    int getEntryCount(int index);
+
+   /**
+    * Set the number of leaf entries in the subtree under a child.
+    * @param index[IN] the position of the child (0 to getKeyCount())
+    * @param count[IN] the number of leaf entries under the child
+    */
+    void setEntryCount(int index, int count);
+
+   /**
+    * Return the number of leaf entries in the subtree under this node.
+    * @return the sum of the entry counts of all children
+    */
+    int getTotalEntryCount();
+
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
     * @param key[IN] the key that should be inserted between the two PageIds
     * @param pid2[IN] the PageId to insert behind the key
+    * @param count1[IN] the number of leaf entries under pid1
+    * @param count2[IN] the number of leaf entries under pid2
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
+    RC initializeRoot(PageId pid1, int key, PageId pid2, int count1 = 0, int count2 = 0);
 
    /**
     * Return the number of keys stored in the node.
@@ -213,9 +258,6 @@ class BTNonLeafNode {
 
   // TODO: comment out 'private'
   private:
-    // Let x=MAX_KEYS. 4x + 4(x+1) + 4 = 1024
-    const static int MAX_KEYS = 127;
-    const static int MAX_PAGES = MAX_KEYS + 1;
    /**
     * The main memory buffer for loading the content of the disk page
     * that contains the node.
@@ -225,7 +267,8 @@ class BTNonLeafNode {
         int keyCount;
         PageId pageEntries[MAX_PAGES];
         int keyEntries[MAX_KEYS];
-        // No garbage space needed
+        // entryCounts[i] is the number of leaf entries under pageEntries[i]
+        int entryCounts[MAX_PAGES];
     };
     union {
         char raw_buff[PageFile::PAGE_SIZE];
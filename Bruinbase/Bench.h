@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <sys/time.h>
+
+/**
+ * Helpers shared by the benchmark drivers bench_*.cc.
+ * "make bench" builds them with BENCHFLAGS (-O2 by default), e.g.
+ * "make bench BENCHFLAGS=-ggdb" measures the debug build.
+ */
+
+/**
+ * @return the wall-clock time in seconds
+ */
+inline double benchNow()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+#endif /* BENCH_H */
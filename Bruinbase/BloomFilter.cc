@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include "BloomFilter.h"
+
+using std::string;
+using std::vector;
+
+//
+// helper functions for hashing
+//
+
+// scramble the bits of a 32-bit value (the murmur3 finalizer)
+static unsigned int mix(unsigned int h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+// compute the i'th bit position of a key inside its block
+static int bitPosition(unsigned int h, int i)
+{
+  // double hashing: derive all probes from two halves of one hash
+  unsigned int step = (h >> 17) | (h << 15) | 1;
+  return (h + i * step) & (BloomFilter::BITS_PER_PAGE - 1);
+}
+
+
+BloomFilter::BloomFilter()
+{
+}
+
+RC BloomFilter::open(const string& filename, char mode)
+{
+  return pf.open(filename, mode);
+}
+
+RC BloomFilter::close()
+{
+  return pf.close();
+}
+
+RC BloomFilter::build(const vector<int>& keys)
+{
+  RC rc;
+
+  if (pf.endPid() != 0) return RC_INVALID_FILE_MODE;
+
+  // size the filter for the requested number of bits per key
+  int numBlocks = (keys.size() * BITS_PER_KEY + BITS_PER_PAGE - 1) / BITS_PER_PAGE;
+  if (numBlocks < 1) numBlocks = 1;
+
+  vector<unsigned char> bits(numBlocks * PageFile::PAGE_SIZE, 0);
+  for (unsigned i = 0; i < keys.size(); i++) {
+    unsigned int   block = mix(keys[i]) % numBlocks;
+    unsigned int   h     = mix(keys[i] ^ 0x9e3779b9);
+    unsigned char* page  = &bits[block * PageFile::PAGE_SIZE];
+    for (int j = 0; j < NUM_HASHES; j++) {
+      int bit = bitPosition(h, j);
+      page[bit >> 3] |= 1 << (bit & 7);
+    }
+  }
+
+  for (PageId pid = 0; pid < numBlocks; pid++) {
+    if ((rc = pf.write(pid, &bits[pid * PageFile::PAGE_SIZE])) < 0) return rc;
+  }
+
+  return 0;
+}
+
+RC BloomFilter::mayContain(int key, bool& result) const
+{
+  RC            rc;
+  unsigned char page[PageFile::PAGE_SIZE];
+
+  if (pf.endPid() == 0) {
+    // an empty filter was never built, so it cannot rule anything out
+    result = true;
+    return 0;
+  }
+
+  unsigned int block = mix(key) % pf.endPid();
+  if ((rc = pf.read(block, page)) < 0) return rc;
+
+  unsigned int h = mix(key ^ 0x9e3779b9);
+  for (int j = 0; j < NUM_HASHES; j++) {
+    int bit = bitPosition(h, j);
+    if (!(page[bit >> 3] & (1 << (bit & 7)))) {
+      result = false;
+      return 0;
+    }
+  }
+
+  result = true;
+  return 0;
+}
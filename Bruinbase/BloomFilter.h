@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * A blocked bloom filter over the keys of a table, stored in a PageFile.
+ * Every page of the file is one block of the filter. A key is hashed to a
+ * single block and all of its bits are set inside that block, so testing
+ * a key costs exactly one page read. The number of blocks is simply the
+ * number of pages in the file, so no header page is needed.
+ */
+class BloomFilter {
+ public:
+  static const int BITS_PER_KEY  = 10;  // ~1% false positives
+  static const int NUM_HASHES    = 7;   // bits set per key
+  static const int BITS_PER_PAGE = PageFile::PAGE_SIZE * 8;
+
+  BloomFilter();
+
+  /**
+   * open the filter file in read or write mode.
+   * under 'w' mode, the file is created if it does not exist.
+   * @param filename[IN] the name of the filter file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename, char mode);
+
+  /**
+   * close the filter file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * build the filter for a set of keys and write it to the file.
+   * the file must be open in 'w' mode and empty.
+   * @param keys[IN] every key of the table
+   * @return error code. 0 if no error
+   */
+  RC build(const std::vector<int>& keys);
+
+  /**
+   * test whether a key may be in the table.
+   * a false answer is always right; a true answer may be a false positive.
+   * @param key[IN] the key to test
+   * @param result[OUT] false if the key is definitely not in the table
+   * @return error code. 0 if no error
+   */
+  RC mayContain(int key, bool& result) const;
+
+ private:
+  PageFile pf;  // the PageFile used to store the filter blocks
+};
+
+#endif // BLOOMFILTER_H
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include "ClusteredIndex.h"
+#include "BTreeNode.h"
+#include "RecordFile.h"
+
+using std::string;
+using std::vector;
+
+// the meta page slots. META_FORMAT holds FORMAT_MAGIC in every file
+// written with entry counts in its non-leaf nodes.
+enum { META_ROOT_PID, META_TREE_HEIGHT, META_NUM_TUPLES, META_FORMAT };
+static const int FORMAT_MAGIC = 0x494f5432;
+
+//
+// helper functions for the leaf page layout:
+// [count][next pid][offset of tuple 0][offset of tuple 1]...
+//                    ...free space...[tuple 1][tuple 0]
+// where a tuple is [key][value length (1 byte)][value bytes]
+//
+
+static const int LEAF_HEADER_SIZE = 2 * sizeof(int);
+
+// get # tuples stored in the leaf
+static int getLeafCount(const char* page)
+{
+  int count;
+  memcpy(&count, page, sizeof(int));
+  return count;
+}
+
+// get the pid of the next leaf
+static PageId getNextPid(const char* page)
+{
+  PageId pid;
+  memcpy(&pid, page + sizeof(int), sizeof(PageId));
+  return pid;
+}
+
+// get a pointer to the n'th tuple in the leaf
+static const char* tuplePtr(const char* page, int n)
+{
+  unsigned short offset;
+  memcpy(&offset, page + LEAF_HEADER_SIZE + n * sizeof(offset), sizeof(offset));
+  return page + offset;
+}
+
+// get the key of the n'th tuple in the leaf
+static int tupleKey(const char* page, int n)
+{
+  int key;
+  memcpy(&key, tuplePtr(page, n), sizeof(int));
+  return key;
+}
+
+// the space a tuple takes in a leaf, including its directory slot
+static int tupleSpace(const string& value)
+{
+  return sizeof(unsigned short) + sizeof(int) + 1 + value.size();
+}
+
+static bool tupleLess(const Tuple& a, const Tuple& b)
+{
+  return a.key < b.key;
+}
+
+
+ClusteredIndex::ClusteredIndex()
+{
+  pfMode     = 'r';
+  rootPid    = -1;
+  treeHeight = 0;
+  numTuples  = 0;
+}
+
+RC ClusteredIndex::open(const string& indexname, char mode)
+{
+  RC  rc;
+  int meta[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if ((rc = pf.open(indexname, mode)) < 0) return rc;
+  pfMode = mode;
+
+  if (pf.endPid() > 0) {
+    if ((rc = pf.read(META_PID, meta)) < 0) {
+      pf.close();
+      return rc;
+    }
+    if (meta[META_FORMAT] != FORMAT_MAGIC) {
+      pf.close();
+      return RC_INVALID_FILE_FORMAT;
+    }
+    rootPid    = meta[META_ROOT_PID];
+    treeHeight = meta[META_TREE_HEIGHT];
+    numTuples  = meta[META_NUM_TUPLES];
+  }
+
+  return 0;
+}
+
+RC ClusteredIndex::close()
+{
+  RC  rc;
+  int meta[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if (pfMode == 'w') {
+    memset(meta, 0, sizeof(meta));
+    meta[META_ROOT_PID]    = rootPid;
+    meta[META_TREE_HEIGHT] = treeHeight;
+    meta[META_NUM_TUPLES]  = numTuples;
+    meta[META_FORMAT]      = FORMAT_MAGIC;
+    if ((rc = pf.write(META_PID, meta)) < 0) return rc;
+  }
+
+  return pf.close();
+}
+
+RC ClusteredIndex::build(vector<Tuple>& tuples)
+{
+  RC rc;
+
+  if (pfMode != 'w' || pf.endPid() > 0) return RC_INVALID_FILE_MODE;
+
+  numTuples = tuples.size();
+  if (tuples.empty()) return 0;
+  stable_sort(tuples.begin(), tuples.end(), tupleLess);
+
+  // values are truncated like RecordFile does
+  for (unsigned i = 0; i < tuples.size(); i++) {
+    if ((int) tuples[i].value.size() >= RecordFile::MAX_VALUE_LENGTH) {
+      tuples[i].value.resize(RecordFile::MAX_VALUE_LENGTH - 1);
+    }
+  }
+
+  // the first key and the pid of every node on the level being built
+  vector<int>    levelKeys;
+  vector<PageId> levelPids;
+
+  // pack as many tuples as fit into every leaf, chaining the leaves
+  // together in page order
+  PageId   pid  = META_PID + 1;
+  unsigned next = 0;
+  while (next < tuples.size()) {
+    char page[PageFile::PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+
+    int count = 0;
+    int top   = PageFile::PAGE_SIZE;   // where the last tuple starts
+    int used  = LEAF_HEADER_SIZE;      // the end of the directory
+    levelKeys.push_back(tuples[next].key);
+    levelPids.push_back(pid);
+    while (next < tuples.size() && used + tupleSpace(tuples[next].value) <= top) {
+      const Tuple&   t   = tuples[next++];
+      unsigned char  len = t.value.size();
+      top -= sizeof(int) + 1 + len;
+      memcpy(page + top, &t.key, sizeof(int));
+      page[top + sizeof(int)] = len;
+      memcpy(page + top + sizeof(int) + 1, t.value.data(), len);
+
+      unsigned short offset = top;
+      memcpy(page + used, &offset, sizeof(offset));
+      used += sizeof(offset);
+      count++;
+    }
+
+    PageId nextPid = next < tuples.size() ? pid + 1 : -1;
+    memcpy(page, &count, sizeof(int));
+    memcpy(page + sizeof(int), &nextPid, sizeof(PageId));
+    if ((rc = pf.write(pid++, page)) < 0) return rc;
+  }
+  treeHeight = 1;
+
+  // build the non-leaf levels until a single node is left. the children
+  // are spread evenly, so every node gets at least two of them.
+  while (levelPids.size() > 1) {
+    vector<int>    parentKeys;
+    vector<PageId> parentPids;
+
+    const int numChildren = levelPids.size();
+    const int numNodes    = (numChildren + BTNonLeafNode::MAX_PAGES - 1) / BTNonLeafNode::MAX_PAGES;
+    int child = 0;
+    for (int i = 0; i < numNodes; i++, pid++) {
+      const int size = numChildren / numNodes + (i < numChildren % numNodes ? 1 : 0);
+
+      BTNonLeafNode node;
+      if ((rc = node.initializeRoot(levelPids[child], levelKeys[child+1], levelPids[child+1])) < 0) return rc;
+      for (int j = child + 2; j < child + size; j++) {
+        if ((rc = node.insert(levelKeys[j], levelPids[j])) < 0) return rc;
+      }
+      if ((rc = node.write(pid, pf)) < 0) return rc;
+
+      parentKeys.push_back(levelKeys[child]);
+      parentPids.push_back(pid);
+      child += size;
+    }
+
+    levelKeys.swap(parentKeys);
+    levelPids.swap(parentPids);
+    treeHeight++;
+  }
+  rootPid = levelPids[0];
+
+  return 0;
+}
+
+RC ClusteredIndex::locate(int searchKey, IndexCursor& cursor)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  cursor.pid = -1;
+  cursor.eid = 0;
+  if (rootPid < 0) return 0;
+
+  PageId pid = rootPid;
+  for (int height = treeHeight; height > 1; height--) {
+    BTNonLeafNode node;
+    if ((rc = node.read(pid, pf)) < 0) return rc;
+    if ((rc = node.locateChildPtr(searchKey, pid)) < 0) return rc;
+  }
+
+  // binary search for the first key not below searchKey
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+  int lo = 0, hi = getLeafCount(page);
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (tupleKey(page, mid) < searchKey) lo = mid + 1;
+    else hi = mid;
+  }
+
+  // the first match is at the start of the next leaf
+  if (lo == getLeafCount(page)) {
+    pid = getNextPid(page);
+    lo  = 0;
+  }
+  cursor.pid = pid;
+  cursor.eid = lo;
+  return 0;
+}
+
+RC ClusteredIndex::readForward(IndexCursor& cursor, int& key, string& value)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  if (cursor.pid < 0) return RC_INVALID_CURSOR;
+  if ((rc = pf.read(cursor.pid, page)) < 0) return rc;
+
+  int count = getLeafCount(page);
+  if (cursor.eid >= count) return RC_INVALID_CURSOR;
+
+  const char* ptr = tuplePtr(page, cursor.eid);
+  memcpy(&key, ptr, sizeof(int));
+  value.assign(ptr + sizeof(int) + 1, (unsigned char) ptr[sizeof(int)]);
+
+  if (++cursor.eid == count) {
+    cursor.pid = getNextPid(page);
+    cursor.eid = 0;
+  }
+  return 0;
+}
+
+RC ClusteredIndex::readAll(vector<Tuple>& tuples)
+{
+  RC          rc;
+  IndexCursor cursor;
+  Tuple       t;
+
+  if ((rc = locate(std::numeric_limits<int>::min(), cursor)) < 0) return rc;
+  while (cursor.pid != -1) {
+    if ((rc = readForward(cursor, t.key, t.value)) < 0) return rc;
+    tuples.push_back(t);
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef CLUSTEREDINDEX_H
+#define CLUSTEREDINDEX_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "BTreeIndex.h"
+
+/**
+ * A (key, value) tuple stored in a clustered index.
+ */
+struct Tuple {
+  int         key;
+  std::string value;
+};
+
+/**
+ * An index-organized table: a B+tree whose leaf nodes hold the tuples
+ * themselves in key order, instead of RecordIds into a separate table
+ * file. A key range is then read with one sequential walk of the leaves
+ * and no random reads into the table.
+ *
+ * A leaf page stores variable-length tuples. It starts with the tuple
+ * count, the pid of the next leaf and a directory of tuple offsets;
+ * the tuples (key, value length, value bytes) are packed from the end
+ * of the page towards the directory. Since values are usually much
+ * shorter than RecordFile::MAX_VALUE_LENGTH, a leaf holds several
+ * times as many tuples as a RecordFile page. The non-leaf levels are
+ * ordinary BTNonLeafNode pages. Page 0 holds the root pid, the tree
+ * height and the number of tuples.
+ *
+ * The tree is bulk-built from the whole table with build(); loading more
+ * tuples into the table rebuilds it.
+ */
+class ClusteredIndex {
+ public:
+  static const int META_PID = 0;
+
+  ClusteredIndex();
+
+  /**
+   * open the index file in read or write mode.
+   * under 'w' mode, the file is created if it does not exist.
+   * a file written in an older layout is not opened.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error, RC_INVALID_FILE_FORMAT if the
+   *         file has an older layout
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * close the index file, writing back the meta page under 'w' mode.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * build the whole tree from the tuples of the table.
+   * the index must be open in 'w' mode on an empty file.
+   * @param tuples[IN/OUT] the tuples to store; they are sorted in place
+   * @return error code. 0 if no error
+   */
+  RC build(std::vector<Tuple>& tuples);
+
+  /**
+   * find the first tuple whose key is larger than or equal to searchKey.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the tuple; pid is -1 if
+   * there is no such tuple
+   * @return error code. 0 if no error
+   */
+  RC locate(int searchKey, IndexCursor& cursor);
+
+  /**
+   * read the tuple at the cursor and move the cursor forward.
+   * @param cursor[IN/OUT] the cursor pointing to a tuple in a leaf
+   * @param key[OUT] the key of the tuple
+   * @param value[OUT] the value of the tuple
+   * @return error code. 0 if no error
+   */
+  RC readForward(IndexCursor& cursor, int& key, std::string& value);
+
+  /**
+   * read every tuple in key order.
+   * @param tuples[OUT] all tuples in the table
+   * @return error code. 0 if no error
+   */
+  RC readAll(std::vector<Tuple>& tuples);
+
+  /**
+   * @return the number of tuples in the table
+   */
+  int getTupleCount() const { return numTuples; }
+
+ private:
+  PageFile pf;          // the PageFile used to store the nodes
+  char     pfMode;      // the mode the file was opened in
+  PageId   rootPid;     // the pid of the root node, -1 if empty
+  int      treeHeight;  // the number of levels, 0 if empty
+  int      numTuples;   // the number of tuples in the table
+};
+
+#endif // CLUSTEREDINDEX_H
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include "HashIndex.h"
+
+using std::string;
+using std::vector;
+
+const double HashIndex::MAX_LOAD = 0.8;
+
+// scramble the bits of a key (the murmur3 finalizer)
+static unsigned int hashKey(int key)
+{
+  unsigned int h = key;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+// the segment holding a bucket and the bucket's offset inside it.
+// segment 0 holds bucket 0 and segment s > 0 holds buckets
+// [2^(s-1), 2^s), so every segment is as large as all previous ones.
+static void segmentOf(int bucket, int& segment, int& offset)
+{
+  segment = 0;
+  while ((1 << segment) <= bucket) segment++;
+  offset = segment == 0 ? 0 : bucket - (1 << (segment - 1));
+}
+
+
+HashIndex::HashIndex()
+{
+  pfMode     = 'r';
+  level      = 0;
+  splitPtr   = 0;
+  numEntries = 0;
+  freePid    = -1;
+  for (int i = 0; i < MAX_SEGMENTS; i++) segmentPid[i] = -1;
+}
+
+RC HashIndex::open(const string& indexname, char mode)
+{
+  RC  rc;
+  int header[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if ((rc = pf.open(indexname, mode)) < 0) return rc;
+  pfMode = mode;
+
+  if (pf.endPid() > 0) {
+    if ((rc = pf.read(HEADER_PID, header)) < 0) {
+      pf.close();
+      return rc;
+    }
+    level      = header[HEADER_LEVEL];
+    splitPtr   = header[HEADER_SPLIT];
+    numEntries = header[HEADER_NUM_ENTRIES];
+    freePid    = header[HEADER_FREE_PID];
+    memcpy(segmentPid, header + HEADER_SEGMENTS, sizeof(segmentPid));
+  } else if (mode == 'w') {
+    // a new index starts with a single empty bucket right after the header
+    vector<IndexEntry> none;
+    segmentPid[0] = HEADER_PID + 1;
+    if ((rc = writeChain(segmentPid[0], none)) < 0) {
+      pf.close();
+      return rc;
+    }
+  }
+
+  return 0;
+}
+
+RC HashIndex::close()
+{
+  RC  rc;
+  int header[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if (pfMode == 'w') {
+    memset(header, 0, sizeof(header));
+    header[HEADER_LEVEL]       = level;
+    header[HEADER_SPLIT]       = splitPtr;
+    header[HEADER_NUM_ENTRIES] = numEntries;
+    header[HEADER_FREE_PID]    = freePid;
+    memcpy(header + HEADER_SEGMENTS, segmentPid, sizeof(segmentPid));
+    if ((rc = pf.write(HEADER_PID, header)) < 0) return rc;
+  }
+
+  return pf.close();
+}
+
+PageId HashIndex::bucketPid(int bucket) const
+{
+  int segment, offset;
+  segmentOf(bucket, segment, offset);
+  return segmentPid[segment] + offset;
+}
+
+int HashIndex::bucketOf(int key) const
+{
+  unsigned int h      = hashKey(key);
+  unsigned int bucket = h & ((1u << level) - 1);
+
+  // buckets before the split pointer have already been split,
+  // so one more bit of the hash tells which half the key is in
+  if (bucket < (unsigned int) splitPtr) {
+    bucket = h & ((2u << level) - 1);
+  }
+  return bucket;
+}
+
+RC HashIndex::insert(int key, const RecordId& rid)
+{
+  RC     rc;
+  PageId pid;
+  int    page[PageFile::PAGE_SIZE / sizeof(int)];
+  Bucket* b = (Bucket*) page;
+
+  if (pfMode != 'w') return RC_INVALID_FILE_MODE;
+
+  // walk to the last page of the bucket
+  pid = bucketPid(bucketOf(key));
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+  while (b->next != -1) {
+    pid = b->next;
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+  }
+
+  if (b->count < ENTRIES_PER_BUCKET) {
+    b->entries[b->count].key = key;
+    b->entries[b->count].rid = rid;
+    b->count++;
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+  } else {
+    // the bucket is full; chain a new overflow page to it
+    int     opage[PageFile::PAGE_SIZE / sizeof(int)];
+    Bucket* o = (Bucket*) opage;
+    PageId  opid;
+
+    if ((rc = allocatePage(opid)) < 0) return rc;
+    memset(opage, 0, sizeof(opage));
+    o->count = 1;
+    o->next  = -1;
+    o->entries[0].key = key;
+    o->entries[0].rid = rid;
+    if ((rc = pf.write(opid, opage)) < 0) return rc;
+
+    b->next = opid;
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+  }
+  numEntries++;
+
+  // grow the table by one bucket if it is getting too full
+  int numBuckets = (1 << level) + splitPtr;
+  if (numEntries > MAX_LOAD * numBuckets * ENTRIES_PER_BUCKET) {
+    return split();
+  }
+  return 0;
+}
+
+RC HashIndex::locate(int key, RecordId& rid) const
+{
+  RC     rc;
+  PageId pid;
+  int    page[PageFile::PAGE_SIZE / sizeof(int)];
+  Bucket* b = (Bucket*) page;
+
+  if (segmentPid[0] < 0) return RC_NO_SUCH_RECORD;
+
+  for (pid = bucketPid(bucketOf(key)); pid != -1; pid = b->next) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    for (int i = 0; i < b->count; i++) {
+      if (b->entries[i].key == key) {
+        rid = b->entries[i].rid;
+        return 0;
+      }
+    }
+  }
+
+  return RC_NO_SUCH_RECORD;
+}
+
+RC HashIndex::split()
+{
+  RC     rc;
+  int    newBucket = splitPtr + (1 << level);
+  int    segment, offset;
+
+  // the first bucket of a segment allocates the whole segment
+  segmentOf(newBucket, segment, offset);
+  if (segment >= MAX_SEGMENTS) return 0;
+  if (segmentPid[segment] < 0) {
+    vector<IndexEntry> none;
+    PageId first = pf.endPid();
+    for (int i = 0; i < (1 << (segment - 1)); i++) {
+      if ((rc = writeChain(first + i, none)) < 0) return rc;
+    }
+    segmentPid[segment] = first;
+  }
+
+  // move the entries whose next hash bit is set to the new bucket
+  vector<IndexEntry> entries, stay, move;
+  PageId oldPid = bucketPid(splitPtr);
+  if ((rc = readChain(oldPid, entries)) < 0) return rc;
+  for (unsigned i = 0; i < entries.size(); i++) {
+    if (hashKey(entries[i].key) & (1u << level)) {
+      move.push_back(entries[i]);
+    } else {
+      stay.push_back(entries[i]);
+    }
+  }
+  if ((rc = writeChain(oldPid, stay)) < 0) return rc;
+  if ((rc = writeChain(bucketPid(newBucket), move)) < 0) return rc;
+
+  // advance the split pointer, starting a new round after the last bucket
+  if (++splitPtr == (1 << level)) {
+    level++;
+    splitPtr = 0;
+  }
+  return 0;
+}
+
+RC HashIndex::readChain(PageId pid, vector<IndexEntry>& entries)
+{
+  RC      rc;
+  int     page[PageFile::PAGE_SIZE / sizeof(int)];
+  Bucket* b = (Bucket*) page;
+  bool    primary = true;
+
+  // collect the entries of every page in the chain; the overflow pages
+  // are put on the free list, since the caller rewrites the chain
+  while (pid != -1) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    entries.insert(entries.end(), b->entries, b->entries + b->count);
+
+    PageId next = b->next;
+    if (!primary) {
+      b->count = 0;
+      b->next  = freePid;
+      if ((rc = pf.write(pid, page)) < 0) return rc;
+      freePid = pid;
+    }
+    primary = false;
+    pid = next;
+  }
+  return 0;
+}
+
+RC HashIndex::writeChain(PageId pid, const vector<IndexEntry>& entries)
+{
+  RC       rc;
+  int      page[PageFile::PAGE_SIZE / sizeof(int)];
+  Bucket*  b = (Bucket*) page;
+  unsigned i = 0;
+
+  for (;;) {
+    memset(page, 0, sizeof(page));
+    while (i < entries.size() && b->count < ENTRIES_PER_BUCKET) {
+      b->entries[b->count++] = entries[i++];
+    }
+
+    PageId next = -1;
+    if (i < entries.size()) {
+      if ((rc = allocatePage(next)) < 0) return rc;
+    }
+    b->next = next;
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+
+    if (next == -1) return 0;
+    pid = next;
+  }
+}
+
+RC HashIndex::allocatePage(PageId& pid)
+{
+  RC  rc;
+  int page[PageFile::PAGE_SIZE / sizeof(int)];
+
+  // reuse a freed overflow page before growing the file
+  if (freePid != -1) {
+    pid = freePid;
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    freePid = ((Bucket*) page)->next;
+    return 0;
+  }
+
+  pid = pf.endPid();
+  return 0;
+}
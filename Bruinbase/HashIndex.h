@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "BTreeIndex.h"
+
+/**
+ * A disk-based linear hash index from keys to RecordIds.
+ * Page 0 is a header holding the hashing state. Every other page is a
+ * bucket of (key, rid) pairs, with a link to an overflow page when the
+ * bucket is full.
+ *
+ * The table grows one bucket at a time: whenever the average bucket
+ * fill exceeds MAX_LOAD, the bucket at the split pointer is split in two
+ * by one more bit of the key hash. Primary buckets are allocated in
+ * segments that double in size (1, 1, 2, 4, 8, ... buckets), each one
+ * contiguous in the file, and the header records where every segment
+ * starts. A bucket's page id is therefore computed from the header
+ * alone, and a lookup reads exactly one bucket page (plus its overflow
+ * pages, which are rare).
+ */
+class HashIndex {
+ public:
+  static const int HEADER_PID = 0;
+
+  /// the number of (key, rid) pairs in a bucket page
+  static const int ENTRIES_PER_BUCKET =
+    (PageFile::PAGE_SIZE - 2 * sizeof(int)) / sizeof(IndexEntry);
+
+  /// the average bucket fill that triggers a split
+  static const double MAX_LOAD;
+
+  HashIndex();
+
+  /**
+   * open the index file in read or write mode.
+   * under 'w' mode, the file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * close the index file, writing back the header under 'w' mode.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * insert a (key, rid) pair into the index.
+   * @param key[IN] the key of the tuple
+   * @param rid[IN] the RecordId of the tuple
+   * @return error code. 0 if no error
+   */
+  RC insert(int key, const RecordId& rid);
+
+  /**
+   * find the RecordId of the tuple with the given key.
+   * @param key[IN] the key to find
+   * @param rid[OUT] the RecordId of the tuple
+   * @return error code. RC_NO_SUCH_RECORD if the key is not in the index
+   */
+  RC locate(int key, RecordId& rid) const;
+
+ private:
+  // the layout of a bucket page
+  struct Bucket {
+    int        count;  // the number of entries in the page
+    PageId     next;   // the next overflow page, or -1
+    IndexEntry entries[ENTRIES_PER_BUCKET];
+  };
+
+  // the slots of the header page
+  enum {
+    HEADER_LEVEL,       // the number of hash bits of unsplit buckets
+    HEADER_SPLIT,       // the next bucket to split
+    HEADER_NUM_ENTRIES, // the number of entries in the index
+    HEADER_FREE_PID,    // the first page of the free overflow page list
+    HEADER_SEGMENTS,    // the first page id of every bucket segment
+    MAX_SEGMENTS = 31
+  };
+
+  PageId bucketPid(int bucket) const;
+  int    bucketOf(int key) const;
+
+  RC split();
+  RC readChain(PageId pid, std::vector<IndexEntry>& entries);
+  RC writeChain(PageId pid, const std::vector<IndexEntry>& entries);
+  RC allocatePage(PageId& pid);
+
+  PageFile pf;          // the PageFile used to store the buckets
+  char     pfMode;      // the mode the file was opened in
+
+  int      level;       // buckets below the split pointer use level+1 bits
+  int      splitPtr;    // the next bucket to split
+  int      numEntries;  // the number of entries in the index
+  PageId   freePid;     // the head of the free overflow page list
+  PageId   segmentPid[MAX_SEGMENTS];  // the first page id of every segment
+};
+
+#endif // HASHINDEX_H
@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "Join.h"
+#include "ArtIndex.h"
+#include "HashIndex.h"
+#include "ValueIndex.h"
+
+using std::string;
+using std::vector;
+
+// append a tuple to a partition file
+static RC writeTuple(FILE* file, int key, const string& value)
+{
+  int header[2] = {key, (int) value.size()};
+  if (fwrite(header, sizeof(header), 1, file) != 1 ||
+      fwrite(value.data(), 1, header[1], file) != (size_t) header[1]) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  return 0;
+}
+
+// read the next tuple of a partition file
+static RC readTuple(FILE* file, Tuple& tuple, bool& found)
+{
+  int header[2];
+
+  found = false;
+  if (fread(header, sizeof(header), 1, file) != 1) {
+    return feof(file) ? 0 : RC_FILE_READ_FAILED;
+  }
+  tuple.key = header[0];
+  tuple.value.resize(header[1]);
+  if (header[1] > 0 && fread(&tuple.value[0], 1, header[1], file) != (size_t) header[1]) {
+    return RC_FILE_READ_FAILED;
+  }
+  found = true;
+  return 0;
+}
+
+// the partition of a tuple spilled by a hash join, from the top bits of
+// its hash; the buckets of a partition, at most MEMORY_TUPLES of them,
+// use the bottom bits
+static int partitionOf(unsigned hash)
+{
+  return (hash >> 24) % HashJoin::PARTITIONS;
+}
+
+// add a joined row, putting the tuple of the first table in the FROM
+// clause first
+static void addRow(JoinBatch& batch, int side, int key, const string& value,
+                   int otherKey, const string& otherValue)
+{
+  if (side == 0) {
+    batch.add(key, value, otherKey, otherValue);
+  } else {
+    batch.add(otherKey, otherValue, key, value);
+  }
+}
+
+
+RC TupleReader::peek(bool& found)
+{
+  RC rc;
+
+  while (pos >= batch.size()) {
+    if (done) {
+      found = false;
+      return 0;
+    }
+    if ((rc = child->next(batch)) < 0) return rc;
+    pos = 0;
+    if (batch.size() == 0) done = true;
+  }
+  found = true;
+  return 0;
+}
+
+
+RC MergeJoin::next(JoinBatch& batch)
+{
+  RC   rc;
+  bool found;
+
+  batch.clear();
+  while (!batch.full()) {
+    if (matching) {
+      batch.add(leftKey, leftValue, group[groupNext].key, group[groupNext].value);
+      if (++groupNext == group.size()) matching = false;
+      continue;
+    }
+
+    if ((rc = left.peek(found)) < 0) return rc;
+    if (!found) break;
+    leftKey   = left.key();
+    leftValue = left.value();
+    left.pop();
+
+    // a left key below the current group has no match; one above it
+    // starts a new group, skipping the right tuples below it
+    if (!group.empty() && group[0].key > leftKey) continue;
+    if (group.empty() || group[0].key < leftKey) {
+      group.clear();
+      for (;;) {
+        if ((rc = right.peek(found)) < 0) return rc;
+        if (!found || right.key() > leftKey) break;
+        if (right.key() == leftKey) {
+          Tuple tuple = {right.key(), right.value()};
+          group.push_back(tuple);
+        }
+        right.pop();
+      }
+      if (group.empty()) continue;
+    }
+    matching  = true;
+    groupNext = 0;
+  }
+  return 0;
+}
+
+
+HashJoin::HashJoin(Operator* build, Operator* probe, int buildSide, int attr)
+  : build(build), probe(probe), buildSide(buildSide), attr(attr), started(false),
+    spilled(0), probing(false), candidate(-1), part(-1), partDone(true)
+{
+}
+
+HashJoin::~HashJoin()
+{
+  for (unsigned i = 0; i < buildParts.size(); i++) fclose(buildParts[i]);
+  for (unsigned i = 0; i < probeParts.size(); i++) fclose(probeParts[i]);
+}
+
+// the hash of the joined column of a tuple
+unsigned HashJoin::hashOf(int key, const string& value) const
+{
+  unsigned hash;
+  if (attr == 1) {
+    hash = (unsigned) key * 0x9e3779b1u;
+    hash ^= hash >> 15;
+  } else {
+    // FNV-1a
+    hash = 2166136261u;
+    for (unsigned i = 0; i < value.size(); i++) {
+      hash = (hash ^ (unsigned char) value[i]) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+// chain the tuples in memory into buckets, about one tuple per bucket
+void HashJoin::buildTable()
+{
+  unsigned size = 1;
+  while (size < tuples.size()) size *= 2;
+  buckets.assign(size, -1);
+  chain.resize(tuples.size());
+  for (unsigned i = 0; i < tuples.size(); i++) {
+    unsigned bucket = hashOf(tuples[i].key, tuples[i].value) & (size - 1);
+    chain[i]        = buckets[bucket];
+    buckets[bucket] = i;
+  }
+}
+
+// create the partition files and move the build tuples in memory there
+RC HashJoin::spill()
+{
+  RC rc;
+
+  for (int i = 0; i < PARTITIONS; i++) {
+    FILE* buildPart = tmpfile();
+    if (buildPart == NULL) return RC_FILE_OPEN_FAILED;
+    buildParts.push_back(buildPart);
+    FILE* probePart = tmpfile();
+    if (probePart == NULL) return RC_FILE_OPEN_FAILED;
+    probeParts.push_back(probePart);
+  }
+  for (unsigned i = 0; i < tuples.size(); i++) {
+    FILE* buildPart = buildParts[partitionOf(hashOf(tuples[i].key, tuples[i].value))];
+    if ((rc = writeTuple(buildPart, tuples[i].key, tuples[i].value)) < 0) return rc;
+  }
+  spilled += tuples.size();
+  tuples.clear();
+  return 0;
+}
+
+// read the build input into the hash table, or into partitions along
+// with the probe input once it does not fit
+RC HashJoin::consume()
+{
+  RC   rc;
+  bool found;
+
+  for (;;) {
+    if ((rc = build.peek(found)) < 0) return rc;
+    if (!found) break;
+    if (buildParts.empty() && tuples.size() == (unsigned) MEMORY_TUPLES && (rc = spill()) < 0) {
+      return rc;
+    }
+    if (buildParts.empty()) {
+      Tuple tuple = {build.key(), build.value()};
+      tuples.push_back(tuple);
+    } else {
+      FILE* buildPart = buildParts[partitionOf(hashOf(build.key(), build.value()))];
+      if ((rc = writeTuple(buildPart, build.key(), build.value())) < 0) return rc;
+      spilled++;
+    }
+    build.pop();
+  }
+
+  if (buildParts.empty()) {
+    buildTable();
+    return 0;
+  }
+
+  for (;;) {
+    if ((rc = probe.peek(found)) < 0) return rc;
+    if (!found) break;
+    FILE* probePart = probeParts[partitionOf(hashOf(probe.key(), probe.value()))];
+    if ((rc = writeTuple(probePart, probe.key(), probe.value())) < 0) return rc;
+    spilled++;
+    probe.pop();
+  }
+  for (int i = 0; i < PARTITIONS; i++) {
+    if (fflush(buildParts[i]) != 0 || fseek(buildParts[i], 0, SEEK_SET) != 0) {
+      return RC_FILE_WRITE_FAILED;
+    }
+    if (fflush(probeParts[i]) != 0) return RC_FILE_WRITE_FAILED;
+  }
+  return 0;
+}
+
+// load the next piece of build tuples from the partitions into the hash
+// table, and rewind the probe partition to join it with
+RC HashJoin::loadPartition(bool& loaded)
+{
+  RC    rc;
+  Tuple tuple;
+  bool  found;
+
+  loaded = false;
+  tuples.clear();
+  while (tuples.empty()) {
+    if (partDone) {
+      if (part + 1 >= PARTITIONS) {
+        part = PARTITIONS;
+        return 0;
+      }
+      part++;
+      partDone = false;
+    }
+    while (tuples.size() < (unsigned) MEMORY_TUPLES) {
+      if ((rc = readTuple(buildParts[part], tuple, found)) < 0) return rc;
+      if (!found) {
+        partDone = true;
+        break;
+      }
+      tuples.push_back(tuple);
+    }
+  }
+
+  if (fseek(probeParts[part], 0, SEEK_SET) != 0) return RC_FILE_SEEK_FAILED;
+  buildTable();
+  loaded = true;
+  return 0;
+}
+
+// the next tuple to probe the hash table with
+RC HashJoin::nextProbe(bool& found)
+{
+  RC rc;
+
+  if (buildParts.empty()) {
+    // nothing can match an empty build input
+    found = false;
+    if (tuples.empty()) return 0;
+    if ((rc = probe.peek(found)) < 0 || !found) return rc;
+    probeTuple.key   = probe.key();
+    probeTuple.value = probe.value();
+    probe.pop();
+    return 0;
+  }
+
+  for (;;) {
+    if (part >= 0 && part < PARTITIONS) {
+      if ((rc = readTuple(probeParts[part], probeTuple, found)) < 0 || found) return rc;
+    }
+    bool loaded;
+    if ((rc = loadPartition(loaded)) < 0) return rc;
+    if (!loaded) {
+      found = false;
+      return 0;
+    }
+  }
+}
+
+RC HashJoin::next(JoinBatch& batch)
+{
+  RC   rc;
+  bool found;
+
+  batch.clear();
+  if (!started) {
+    started = true;
+    if ((rc = consume()) < 0) return rc;
+  }
+
+  while (!batch.full()) {
+    if (probing) {
+      while (candidate != -1 && !batch.full()) {
+        const Tuple& tuple = tuples[candidate];
+        candidate = chain[candidate];
+        if (attr == 1 ? tuple.key == probeTuple.key : tuple.value == probeTuple.value) {
+          addRow(batch, buildSide, tuple.key, tuple.value, probeTuple.key, probeTuple.value);
+        }
+      }
+      if (candidate != -1) break;
+      probing = false;
+    }
+
+    if ((rc = nextProbe(found)) < 0) return rc;
+    if (!found) break;
+    unsigned hash = hashOf(probeTuple.key, probeTuple.value);
+    candidate = buckets[hash & (buckets.size() - 1)];
+    probing   = true;
+  }
+  return 0;
+}
+
+
+// keep an inner tuple found in the index if it meets the conditions on
+// the inner table, reading its value from the table if it is needed and
+// not already known
+RC IndexNestedLoopJoin::check(int key, const RecordId& rid, const string* value)
+{
+  RC    rc;
+  Tuple tuple;
+
+  if (!inner.pred->matchesKey(key)) return 0;
+  tuple.key = key;
+  if (value != NULL) {
+    tuple.value = *value;
+  } else if (inner.needValue || attr == 2) {
+    if ((rc = inner.rf->read(rid, tuple.key, tuple.value)) < 0) return rc;
+    if (attr == 2 && tuple.value != outerValue) return 0;
+  }
+  if (inner.pred->hasValueConds() && !inner.pred->matchesValue(key, tuple.value)) return 0;
+  matches.push_back(tuple);
+  return 0;
+}
+
+// find the inner tuples that join with the outer tuple
+RC IndexNestedLoopJoin::lookup(int key, const string& value)
+{
+  RC          rc;
+  IndexCursor cursor;
+  RecordId    rid;
+  int         foundKey;
+
+  if (attr == 2) {
+    // the entries with the prefix of the value, whose full value is in
+    // the entry unless it was truncated
+    ValueEntry entry;
+    if ((rc = inner.valueIndex->locate(value, cursor)) < 0) return rc;
+    while (cursor.pid != -1) {
+      if ((rc = inner.valueIndex->readForward(cursor, entry)) < 0) return rc;
+      if (ValueIndex::comparePrefix(entry, value) != 0) break;
+      if (!ValueIndex::isExact(entry)) {
+        rc = check(entry.key, entry.rid, NULL);
+      } else if (ValueIndex::prefixOf(entry) == value) {
+        rc = check(entry.key, entry.rid, &value);
+      }
+      if (rc < 0) return rc;
+    }
+    return 0;
+  }
+
+  if (!inner.pred->matchesKey(key)) return 0;
+  if (inner.hash != NULL) {
+    rc = inner.hash->locate(key, rid);
+    if (rc == RC_NO_SUCH_RECORD) return 0;
+    if (rc < 0) return rc;
+    return check(key, rid, NULL);
+  }
+
+  if (inner.clustered != NULL) {
+    Tuple tuple;
+    if (inner.clustered->locate(key, cursor) != 0 || cursor.pid == -1) return 0;
+    if ((rc = inner.clustered->readForward(cursor, tuple.key, tuple.value)) < 0) return rc;
+    if (tuple.key == key && inner.pred->matches(tuple.key, tuple.value)) matches.push_back(tuple);
+    return 0;
+  }
+
+  if (inner.tree != NULL) {
+    if (inner.tree->getTreeHeight() == 0 || inner.tree->locate(key, cursor) != 0
+        || cursor.pid == -1) {
+      return 0;
+    }
+    if ((rc = inner.tree->readForward(cursor, foundKey, rid)) < 0) return rc;
+  } else {
+    if (inner.resident->locate(key, cursor) != 0 || cursor.pid == -1) return 0;
+    if ((rc = inner.resident->readForward(cursor, foundKey, rid)) < 0) return rc;
+  }
+  return foundKey == key ? check(key, rid, NULL) : 0;
+}
+
+RC IndexNestedLoopJoin::next(JoinBatch& batch)
+{
+  RC   rc;
+  bool found;
+
+  batch.clear();
+  while (!batch.full()) {
+    if (matchNext < matches.size()) {
+      const Tuple& match = matches[matchNext++];
+      addRow(batch, outerSide, outerKey, outerValue, match.key, match.value);
+      continue;
+    }
+
+    if ((rc = outer.peek(found)) < 0) return rc;
+    if (!found) break;
+    outerKey   = outer.key();
+    outerValue = outer.value();
+    outer.pop();
+
+    matches.clear();
+    matchNext = 0;
+    if ((rc = lookup(outerKey, outerValue)) < 0) return rc;
+  }
+  return 0;
+}
+
+
+// compare a column of one table with a column of the other
+static bool compareFields(const JoinBatch& batch, int row, const JoinCompare& compare)
+{
+  int diff;
+  if (compare.left.attr == 1) {
+    int a = batch.keys[compare.left.side][row];
+    int b = batch.keys[compare.right.side][row];
+    diff = a < b ? -1 : (a > b ? 1 : 0);
+  } else {
+    diff = strcmp(batch.values[compare.left.side][row].c_str(),
+                  batch.values[compare.right.side][row].c_str());
+  }
+
+  switch (compare.comp) {
+    case SelCond::EQ: return diff == 0;
+    case SelCond::NE: return diff != 0;
+    case SelCond::GT: return diff > 0;
+    case SelCond::LT: return diff < 0;
+    case SelCond::GE: return diff >= 0;
+    case SelCond::LE: return diff <= 0;
+    case SelCond::IN_KEYS: break;
+  }
+  return false;
+}
+
+RC JoinFilter::next(JoinBatch& batch)
+{
+  RC rc;
+
+  // keep pulling until some row of a batch matches, or the child ends
+  do {
+    if ((rc = child->next(batch)) < 0) return rc;
+    if (batch.count == 0) return 0;
+
+    int kept = 0;
+    for (int i = 0; i < batch.count; i++) {
+      bool match = true;
+      for (unsigned j = 0; j < compares.size() && match; j++) {
+        match = compareFields(batch, i, compares[j]);
+      }
+      if (!match) continue;
+      if (kept != i) {
+        batch.keys[0][kept] = batch.keys[0][i];
+        batch.keys[1][kept] = batch.keys[1][i];
+        batch.values[0][kept].swap(batch.values[0][i]);
+        batch.values[1][kept].swap(batch.values[1][i]);
+      }
+      kept++;
+    }
+    batch.count = kept;
+  } while (batch.count == 0);
+
+  return 0;
+}
+
+
+RC JoinOutput::next(JoinBatch& batch)
+{
+  RC rc;
+
+  if ((rc = child->next(batch)) < 0) return rc;
+  if (count) {
+    rows += batch.count;
+    if (batch.count == 0 && !done) {
+      fprintf(stdout, "%lld\n", rows);
+      done = true;
+    }
+    return 0;
+  }
+
+  // a single column is printed as is, like SELECT key or SELECT value;
+  // with more, the values are quoted like SELECT *
+  for (int i = 0; i < batch.count; i++) {
+    for (unsigned j = 0; j < fields.size(); j++) {
+      const JoinField& field = fields[j];
+      if (j > 0) fputc(' ', stdout);
+      if (field.attr == 1) {
+        fprintf(stdout, "%d", batch.keys[field.side][i]);
+      } else if (fields.size() == 1) {
+        fprintf(stdout, "%s", batch.values[field.side][i].c_str());
+      } else {
+        fprintf(stdout, "'%s'", batch.values[field.side][i].c_str());
+      }
+    }
+    fputc('\n', stdout);
+  }
+  return 0;
+}
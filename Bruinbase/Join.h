@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "Operator.h"
+#include "ClusteredIndex.h"
+
+/**
+ * A column of one of the two tables of a join.
+ */
+struct JoinField {
+  int side;  // 0 - the first table in the FROM clause, 1 - the second
+  int attr;  // 1 - key, 2 - value
+};
+
+/**
+ * A condition comparing a column of one table of a join with a column
+ * of the other, checked on the joined rows.
+ */
+struct JoinCompare {
+  JoinField           left;
+  SelCond::Comparator comp;
+  JoinField           right;
+};
+
+/**
+ * A batch of joined rows passed from one join operator to the next.
+ * Row i pairs the tuple (keys[0][i], values[0][i]) of the first table in
+ * the FROM clause with the tuple (keys[1][i], values[1][i]) of the
+ * second. The values of a table are only filled in when they were asked
+ * for.
+ */
+struct JoinBatch {
+  static const int CAPACITY = TupleBatch::CAPACITY;
+
+  int         count;
+  int         keys[2][CAPACITY];
+  std::string values[2][CAPACITY];
+
+  JoinBatch() : count(0) {}
+
+  bool full() const { return count == CAPACITY; }
+  void clear()      { count = 0; }
+  void add(int key0, const std::string& value0, int key1, const std::string& value1)
+  {
+    keys[0][count]   = key0;
+    values[0][count] = value0;
+    keys[1][count]   = key1;
+    values[1][count++] = value1;
+  }
+};
+
+/**
+ * An operator of a join plan. Like Operator, the root pulls batches of
+ * joined rows out of its children with next(); the joins at the bottom
+ * pull the tuples of each table out of an Operator reading it.
+ * Operators own their children and delete them when they are deleted.
+ */
+class JoinOperator {
+ public:
+  virtual ~JoinOperator() {}
+
+  /**
+   * produce the next batch of joined rows.
+   * @param batch[OUT] the rows; it is empty when there are no more
+   * @return error code. 0 if no error
+   */
+  virtual RC next(JoinBatch& batch) = 0;
+};
+
+/**
+ * Read the tuples of an operator one at a time.
+ */
+class TupleReader {
+ public:
+  explicit TupleReader(Operator* child) : child(child), pos(0), done(false) {}
+  ~TupleReader() { delete child; }
+
+  /**
+   * make sure a tuple is at the front, pulling the next batch if needed.
+   * @param found[OUT] false when the child has no more tuples
+   * @return error code. 0 if no error
+   */
+  RC peek(bool& found);
+
+  int                key() const   { return batch.keys[batch.at(pos)]; }
+  const std::string& value() const { return batch.values[batch.at(pos)]; }
+  void               pop()         { pos++; }
+
+ private:
+  Operator*  child;
+  TupleBatch batch;
+  int        pos;   // the front tuple is the pos'th of the batch
+  bool       done;
+};
+
+/**
+ * Join two tables on their keys by merging two inputs in ascending key
+ * order, as read by an IndexRangeScan over a B+tree or a memory-resident
+ * index, or by a ClusteredScan. Each input is read once, and a key that
+ * one input skips costs nothing in the other. The tuples of the right
+ * input with the key of the current left tuple are kept in memory, so
+ * duplicate keys on either side join correctly.
+ */
+class MergeJoin : public JoinOperator {
+ public:
+  MergeJoin(Operator* left, Operator* right)
+    : left(left), right(right), matching(false), groupNext(0) {}
+  RC next(JoinBatch& batch);
+
+ private:
+  TupleReader        left;
+  TupleReader        right;
+  bool               matching;   // whether the left tuple is being paired with group
+  int                leftKey;
+  std::string        leftValue;
+  std::vector<Tuple> group;      // the right tuples with the key of group[0]
+  unsigned           groupNext;  // the next one to pair with the left tuple
+};
+
+/**
+ * Join two tables on their keys or their values with a hash table built
+ * over the tuples of the build input, probed with those of the other.
+ * When the build input holds more than MEMORY_TUPLES tuples, both inputs
+ * are split by hash into PARTITIONS temporary files, and each pair of
+ * partitions is joined on its own; a build partition that still does not
+ * fit is joined in pieces of MEMORY_TUPLES, reading its probe partition
+ * once per piece.
+ */
+class HashJoin : public JoinOperator {
+ public:
+  /// the number of build tuples held in memory at a time
+  static const int MEMORY_TUPLES = 65536;
+
+  /// the number of partitions the inputs are split into when they spill
+  static const int PARTITIONS = 16;
+
+  /**
+   * @param build[IN] the input the hash table is built over
+   * @param probe[IN] the other input
+   * @param buildSide[IN] the table of the build input (0: the first table
+   * in the FROM clause, 1: the second)
+   * @param attr[IN] the joined column (1: key, 2: value)
+   */
+  HashJoin(Operator* build, Operator* probe, int buildSide, int attr);
+  ~HashJoin();
+  RC next(JoinBatch& batch);
+
+  /**
+   * @return the number of tuples written to the partition files
+   */
+  int getSpilledTuples() const { return spilled; }
+
+ private:
+  RC consume();
+  RC spill();
+  RC loadPartition(bool& loaded);
+  RC nextProbe(bool& found);
+  unsigned hashOf(int key, const std::string& value) const;
+  void buildTable();
+
+  TupleReader        build;
+  TupleReader        probe;
+  int                buildSide;
+  int                attr;
+  bool               started;
+  int                spilled;
+
+  // the hash table: buckets hold the position in tuples of the first
+  // tuple of their chain, and chain the position of the next one
+  std::vector<Tuple> tuples;
+  std::vector<int>   buckets;
+  std::vector<int>   chain;
+
+  // the probe tuple being matched, and the next candidate in its chain
+  bool               probing;
+  Tuple              probeTuple;
+  int                candidate;
+
+  // the partition files while spilling, and the one being joined
+  std::vector<FILE*> buildParts;
+  std::vector<FILE*> probeParts;
+  int                part;
+  bool               partDone;    // whether the build partition is all loaded
+};
+
+/**
+ * Join two tables by looking up every tuple of the outer input in the
+ * index of the inner table on the joined column: its B+tree, its
+ * memory-resident or hash index, its clustered index, or, for a join on
+ * the value, its value index. The inner tuples found are checked against
+ * the conditions on the inner table.
+ */
+class IndexNestedLoopJoin : public JoinOperator {
+ public:
+  /**
+   * The index of the inner table on the joined column, and the table.
+   * Exactly one of the indexes is set.
+   */
+  struct Inner {
+    BTreeIndex*      tree;
+    const ArtIndex*  resident;
+    HashIndex*       hash;
+    ClusteredIndex*  clustered;
+    ValueIndex*      valueIndex;
+    RecordFile*      rf;
+    const Predicate* pred;       // the conditions on the inner table
+    bool             needValue;  // whether the inner values are needed
+  };
+
+  /**
+   * @param outer[IN] the outer input
+   * @param outerSide[IN] the table of the outer input (0: the first table
+   * in the FROM clause, 1: the second)
+   * @param attr[IN] the joined column (1: key, 2: value)
+   * @param inner[IN] the index of the inner table
+   */
+  IndexNestedLoopJoin(Operator* outer, int outerSide, int attr, const Inner& inner)
+    : outer(outer), outerSide(outerSide), attr(attr), inner(inner), matchNext(0) {}
+  RC next(JoinBatch& batch);
+
+ private:
+  RC lookup(int key, const std::string& value);
+  RC check(int key, const RecordId& rid, const std::string* value);
+
+  TupleReader        outer;
+  int                outerSide;
+  int                attr;
+  Inner              inner;
+  std::vector<Tuple> matches;    // the inner tuples of the outer tuple
+  unsigned           matchNext;  // the next one to pass on
+  int                outerKey;
+  std::string        outerValue;
+};
+
+/**
+ * Pass on the joined rows that meet every condition comparing a column
+ * of one table with a column of the other.
+ */
+class JoinFilter : public JoinOperator {
+ public:
+  JoinFilter(JoinOperator* child, const std::vector<JoinCompare>& compares)
+    : child(child), compares(compares) {}
+  ~JoinFilter() { delete child; }
+  RC next(JoinBatch& batch);
+
+ private:
+  JoinOperator*            child;
+  std::vector<JoinCompare> compares;
+};
+
+/**
+ * Print the columns in the SELECT clause of every joined row, or with
+ * count, the number of rows once the child has no more.
+ */
+class JoinOutput : public JoinOperator {
+ public:
+  JoinOutput(JoinOperator* child, const std::vector<JoinField>& fields, bool count)
+    : child(child), fields(fields), count(count), rows(0), done(false) {}
+  ~JoinOutput() { delete child; }
+  RC next(JoinBatch& batch);
+
+ private:
+  JoinOperator*          child;
+  std::vector<JoinField> fields;
+  bool                   count;
+  long long              rows;
+  bool                   done;
+};
+
+#endif // JOIN_H
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "LoadFile.h"
+
+// defining NO_AVX2 leaves the AVX2 kernel out, e.g. to time the memchr loop
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_AVX2)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+using std::string;
+using std::vector;
+
+// append the offsets of the newlines in data[from..to) to ends
+static void findNewlinesScalar(const char* data, size_t from, size_t to, vector<size_t>& ends)
+{
+  for (const char* p = data + from; (p = (const char*) memchr(p, '\n', data + to - p)) != NULL; p++) {
+    ends.push_back(p - data);
+  }
+}
+
+#ifdef HAVE_AVX2_KERNEL
+// the same, 32 bytes per compare. the positions of the newlines in a
+// block are read off the bits of its compare mask.
+__attribute__((target("avx2")))
+static void findNewlinesAvx2(const char* data, size_t from, size_t to, vector<size_t>& ends)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t        i       = from;
+
+  for (; i + 32 <= to; i += 32) {
+    __m256i  block = _mm256_loadu_si256((const __m256i*) (data + i));
+    unsigned mask  = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+    while (mask != 0) {
+      ends.push_back(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+
+  // the last few bytes
+  findNewlinesScalar(data, i, to, ends);
+}
+#endif
+
+static void findNewlines(const char* data, size_t from, size_t to, vector<size_t>& ends)
+{
+#ifdef HAVE_AVX2_KERNEL
+  // the kernel is compiled for AVX2 on its own, so check the CPU once
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) {
+    findNewlinesAvx2(data, from, to, ends);
+    return;
+  }
+#endif
+  findNewlinesScalar(data, from, to, ends);
+}
+
+// read the key at s the way atoi() does: white space, an optional sign
+// and the digits after it, saturated to the range of a long like strtol()
+// before the cast to int. no locale is looked up.
+static int parseKey(const char* s, const char* end)
+{
+  while (s < end && (*s == ' ' || (*s >= '\t' && *s <= '\r'))) s++;
+
+  bool negative = false;
+  if (s < end && (*s == '+' || *s == '-')) negative = *s++ == '-';
+
+  const unsigned long limit     = negative ? (unsigned long) LONG_MAX + 1 : LONG_MAX;
+  unsigned long       magnitude = 0;
+  for (; s < end && *s >= '0' && *s <= '9'; s++) {
+    unsigned digit = *s - '0';
+    magnitude = (magnitude > (limit - digit) / 10) ? limit : magnitude * 10 + digit;
+  }
+
+  return (int) (negative ? (long) (0 - magnitude) : (long) magnitude);
+}
+
+// parse the line [s, end) like SqlEngine::parseLoadLine()
+static RC parseLine(const char* s, const char* end, int& key, const char*& value, int& length)
+{
+  // ignore beginning white spaces
+  while (s < end && (*s == ' ' || *s == '\t')) s++;
+
+  // get the integer key value
+  key = parseKey(s, end);
+
+  // look for comma
+  s = (const char*) memchr(s, ',', end - s);
+  if (s == NULL) return RC_INVALID_FILE_FORMAT;
+
+  // ignore white spaces
+  do { s++; } while (s < end && (*s == ' ' || *s == '\t'));
+
+  // if there is nothing left, set the value to empty string
+  if (s == end) {
+    value  = s;
+    length = 0;
+    return 0;
+  }
+
+  // the value ends at the matching quote if it is delimited by ' or ",
+  // and at the end of the line otherwise
+  const char* last = end;
+  if (*s == '\'' || *s == '"') {
+    char quote = *s++;
+    last = (const char*) memchr(s, quote, end - s);
+    if (last == NULL) last = end;
+  }
+  value  = s;
+  length = last - s;
+  return 0;
+}
+
+LoadFile::LoadFile()
+{
+  fd          = -1;
+  data        = NULL;
+  size        = 0;
+  current     = 0;
+  currentNext = 0;
+}
+
+LoadFile::~LoadFile()
+{
+  pool.cancel();
+  pool.wait();
+  if (data != NULL) ::munmap((void*) data, size);
+  if (fd >= 0) ::close(fd);
+}
+
+RC LoadFile::open(const string& filename, int numWorkers)
+{
+  struct stat statbuf;
+
+  if (fd >= 0) return RC_FILE_OPEN_FAILED;
+
+  fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return RC_FILE_OPEN_FAILED;
+  if (::fstat(fd, &statbuf) < 0) {
+    ::close(fd);
+    fd = -1;
+    return RC_FILE_OPEN_FAILED;
+  }
+  size = statbuf.st_size;
+  if (size == 0) return 0;
+
+  // the file is read front to back, so let the kernel read ahead
+  void* mapped = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    ::close(fd);
+    fd = -1;
+    return RC_FILE_OPEN_FAILED;
+  }
+  ::madvise(mapped, size, MADV_SEQUENTIAL);
+  data = (const char*) mapped;
+
+  chunks.resize((size + CHUNK_BYTES - 1) / CHUNK_BYTES);
+  for (unsigned i = 0; i < chunks.size(); i++) chunks[i].rc = 0;
+
+  // keep the tuples of only a few chunks per worker in memory
+  return pool.start(this, chunks.size(), numWorkers, 4 * numWorkers);
+}
+
+RC LoadFile::next(int& key, string& value, bool& found)
+{
+  found = false;
+  while (current < (int) chunks.size()) {
+    Chunk& chunk = chunks[current];
+
+    pool.waitFor(current);
+    if (currentNext < chunk.rows.size()) {
+      const Row& row = chunk.rows[currentNext++];
+      key = row.key;
+      value.assign(row.value, row.length);
+      found = true;
+      return 0;
+    }
+    if (chunk.rc < 0) return chunk.rc;
+
+    // the chunk is used up; free it and let the workers move on
+    vector<Row>().swap(chunk.rows);
+    pool.release();
+    current++;
+    currentNext = 0;
+  }
+  return 0;
+}
+
+void LoadFile::run(int chunk)
+{
+  chunks[chunk].rc = parseChunk(chunk, chunks[chunk]);
+}
+
+RC LoadFile::parseChunk(int chunk, Chunk& result)
+{
+  RC             rc;
+  vector<size_t> ends;
+  size_t         start = (size_t) chunk * CHUNK_BYTES;
+  size_t         end   = std::min(start + CHUNK_BYTES, (size_t) size);
+  Row            row;
+
+  // skip the rest of the line that started in the chunk before
+  size_t first = start;
+  if (start > 0 && data[start - 1] != '\n') {
+    const char* newline = (const char*) memchr(data + start, '\n', end - start);
+    if (newline == NULL) return 0;
+    first = newline - data + 1;
+  }
+
+  // the lines starting in the chunk end at its newlines and at the first
+  // newline after it, or at the end of the file
+  findNewlines(data, first, end, ends);
+  if (ends.empty() || ends.back() != end - 1) {
+    const char* newline = (const char*) memchr(data + end, '\n', size - end);
+    ends.push_back(newline != NULL ? newline - data : size);
+  }
+
+  // a NUL byte ends a line for parseLoadLine(), which sees it as a C string
+  bool hasNul = memchr(data + first, 0, ends.back() - first) != NULL;
+
+  // parse every line like getline() returns it: without the newline,
+  // and the text after the last newline only if there is any
+  size_t begin = first;
+  result.rows.reserve(ends.size());
+  for (unsigned i = 0; i < ends.size() && begin < end && begin < (size_t) size; i++) {
+    const char* lineEnd = data + ends[i];
+    if (hasNul) {
+      const char* nul = (const char*) memchr(data + begin, 0, lineEnd - (data + begin));
+      if (nul != NULL) lineEnd = nul;
+    }
+    if ((rc = parseLine(data + begin, lineEnd, row.key, row.value, row.length)) < 0) return rc;
+    result.rows.push_back(row);
+    begin = ends[i] + 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef LOADFILE_H
+#define LOADFILE_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "Bruinbase.h"
+#include "WorkerPool.h"
+
+/**
+ * Read the tuples of a load file, parsed by several worker threads.
+ * The file is mapped into memory and split into chunks of CHUNK_BYTES
+ * bytes; a line belongs to the chunk it starts in. The workers parse
+ * whole chunks while next() hands out the tuples of the chunks already
+ * parsed, in file order; the workers stay at most a few chunks per worker
+ * ahead of it.
+ * A worker finds the newlines of its chunk 32 bytes at a time with AVX2
+ * instructions when the CPU has them, and parses each line in place with
+ * the rules of SqlEngine::parseLoadLine(): the key as atoi() reads it,
+ * and the value after the comma either up to the matching quote, if it
+ * starts with ' or ", or up to the end of the line. A parsed value is
+ * only a pointer into the mapped file and a length until next() copies
+ * it out, so parsing allocates nothing per line.
+ */
+class LoadFile : private MorselTask {
+ public:
+  /// the number of bytes in a chunk
+  static const int CHUNK_BYTES = 1 << 20;
+
+  LoadFile();
+
+  /**
+   * stop the workers and unmap and close the file.
+   */
+  ~LoadFile();
+
+  /**
+   * open a load file and start parsing it.
+   * @param filename[IN] the name of the load file
+   * @param numWorkers[IN] the number of threads parsing it
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename, int numWorkers);
+
+  /**
+   * get the next tuple of the file.
+   * @param key[OUT] the key of the tuple
+   * @param value[OUT] the value of the tuple
+   * @param found[OUT] false if every tuple has been read
+   * @return error code. 0 if no error; the error of a line that could
+   * not be parsed comes after the tuples of the lines before it
+   */
+  RC next(int& key, std::string& value, bool& found);
+
+ private:
+  // a parsed line; the value is in the mapped file
+  struct Row {
+    int         key;
+    int         length;
+    const char* value;
+  };
+
+  // the tuples parsed from one chunk
+  struct Chunk {
+    RC               rc;
+    std::vector<Row> rows;
+  };
+
+  void run(int chunk);
+  RC   parseChunk(int chunk, Chunk& result);
+
+  int                fd;
+  const char*        data;         // the mapped file
+  off_t              size;
+  WorkerPool         pool;
+  std::vector<Chunk> chunks;
+  int                current;      // the chunk next() is reading
+  unsigned           currentNext;  // the next tuple of it
+};
+
+#endif // LOADFILE_H
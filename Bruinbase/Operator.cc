@@ -0,0 +1,1037 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include "Operator.h"
+#include "ArtIndex.h"
+#include "HashIndex.h"
+#include "ValueIndex.h"
+#include "ClusteredIndex.h"
+
+using std::string;
+using std::vector;
+
+static bool indexEntryRidLess(const IndexEntry& a, const IndexEntry& b)
+{
+  return a.rid < b.rid;
+}
+
+static bool tupleLess(const Tuple& a, const Tuple& b)
+{
+  return a.key < b.key;
+}
+
+TableScan::TableScan(RecordFile& rf, const Predicate& pred, bool prune)
+  : rf(rf), pred(pred), prune(prune)
+{
+  rid.pid = rid.sid = 0;
+}
+
+RC TableScan::next(TupleBatch& batch)
+{
+  RC rc;
+
+  batch.clear();
+  while (!batch.full() && rid < rf.endRid()) {
+    // skip the whole page if none of its keys can be in range
+    if (rid.sid == 0 && prune) {
+      int pageMin, pageMax;
+      if ((rc = rf.getKeyRange(rid.pid, pageMin, pageMax)) < 0) return rc;
+      if (!pred.overlaps(pageMin, pageMax)) {
+        rid.pid++;
+        continue;
+      }
+    }
+
+    // read the tuple straight into the next slot of the batch
+    if ((rc = rf.read(rid, batch.keys[batch.count], batch.values[batch.count])) < 0) return rc;
+    batch.count++;
+    ++rid;
+  }
+  return 0;
+}
+
+
+ParallelScan::ParallelScan(RecordFile& rf, const Predicate& pred, bool prune, bool needValue,
+                           bool countOnly, int numWorkers)
+  : rf(rf), pred(pred), prune(prune), needValue(needValue), countOnly(countOnly),
+    numWorkers(numWorkers)
+{
+  numPages    = rf.endRid().sid > 0 ? rf.endRid().pid + 1 : rf.endRid().pid;
+  started     = false;
+  current     = 0;
+  currentNext = 0;
+  morsels.resize((numPages + MORSEL_PAGES - 1) / MORSEL_PAGES);
+  for (unsigned i = 0; i < morsels.size(); i++) {
+    morsels[i].rc    = 0;
+    morsels[i].count = 0;
+  }
+}
+
+ParallelScan::~ParallelScan()
+{
+  // let the workers skip the morsels nobody will read, and wait for them
+  pool.cancel();
+  pool.wait();
+}
+
+RC ParallelScan::startWorkers()
+{
+  RC  rc;
+  int minKey, maxKey;
+
+  // the first getKeyRange() call looks up the size of the zone map and
+  // remembers it, so make it here before the workers share the file
+  if (prune && numPages > 0 && (rc = rf.getKeyRange(0, minKey, maxKey)) < 0) return rc;
+
+  // keep the tuples of only a few morsels per worker ahead of next()
+  started = true;
+  return pool.start(this, morsels.size(), numWorkers, countOnly ? 0 : 4 * numWorkers);
+}
+
+void ParallelScan::run(int morsel)
+{
+  morsels[morsel].rc = scanMorsel(morsel, morsels[morsel]);
+}
+
+RC ParallelScan::scanMorsel(int morsel, Morsel& result)
+{
+  RC     rc;
+  int    keys[RecordFile::RECORDS_PER_PAGE];
+  string values[RecordFile::RECORDS_PER_PAGE];
+  int    sel[RecordFile::RECORDS_PER_PAGE];
+  int    count, n;
+  PageId endPid     = std::min((morsel + 1) * MORSEL_PAGES, numPages);
+  bool   readValues = needValue || pred.hasValueConds();
+
+  for (PageId pid = morsel * MORSEL_PAGES; pid < endPid; pid++) {
+    // skip the whole page if none of its keys can be in range
+    if (prune) {
+      int pageMin, pageMax;
+      if ((rc = rf.getKeyRange(pid, pageMin, pageMax)) < 0) return rc;
+      if (!pred.overlaps(pageMin, pageMax)) continue;
+    }
+
+    if ((rc = rf.readPage(pid, keys, readValues ? values : NULL, count)) < 0) return rc;
+
+    if (pred.hasKeyConds()) {
+      n = pred.selectKeys(keys, count, sel);
+    } else {
+      for (n = 0; n < count; n++) sel[n] = n;
+    }
+
+    for (int i = 0; i < n; i++) {
+      if (pred.hasValueConds() && !pred.matchesValue(keys[sel[i]], values[sel[i]])) continue;
+      if (countOnly) {
+        result.count++;
+      } else {
+        result.keys.push_back(keys[sel[i]]);
+        if (needValue) result.values.push_back(values[sel[i]]);
+      }
+    }
+  }
+
+  return 0;
+}
+
+RC ParallelScan::next(TupleBatch& batch)
+{
+  RC rc;
+
+  batch.clear();
+  if (!started && (rc = startWorkers()) < 0) return rc;
+
+  if (countOnly) {
+    // the count is only known once every morsel is done
+    if (current == (int) morsels.size()) return 0;
+    pool.wait();
+
+    int count = 0;
+    for (unsigned i = 0; i < morsels.size(); i++) {
+      if (morsels[i].rc < 0) return morsels[i].rc;
+      count += morsels[i].count;
+    }
+    current = morsels.size();
+    batch.add(count, string());
+    return 0;
+  }
+
+  while (!batch.full() && current < (int) morsels.size()) {
+    Morsel& result = morsels[current];
+
+    pool.waitFor(current);
+    if (result.rc < 0) return result.rc;
+
+    while (!batch.full() && currentNext < result.keys.size()) {
+      batch.add(result.keys[currentNext], needValue ? result.values[currentNext] : string());
+      currentNext++;
+    }
+
+    // once a morsel is passed on, free it and let the workers move on
+    if (currentNext == result.keys.size()) {
+      std::vector<int>().swap(result.keys);
+      std::vector<string>().swap(result.values);
+      pool.release();
+      current++;
+      currentNext = 0;
+    }
+  }
+  return 0;
+}
+
+
+IndexRangeScan::IndexRangeScan(BTreeIndex* tree, const ArtIndex* resident, RecordFile& rf,
+                               const vector<KeyRange>& ranges, bool needValue, bool sortedFetch,
+                               bool reverse, int limit)
+  : tree(tree), resident(resident), rf(rf), ranges(ranges), needValue(needValue),
+    sortedFetch(sortedFetch), reverse(reverse), limit(limit)
+{
+  started     = false;
+  range       = 0;
+  numRead     = 0;
+  pointNext   = 0;
+  fetchedNext = 0;
+}
+
+// the range the scan is in
+const KeyRange& IndexRangeScan::currentRange() const
+{
+  return ranges[reverse ? ranges.size() - 1 - range : range];
+}
+
+// the number of keys from key up to the first one of the range in the
+// direction of the scan
+static long long distanceTo(int key, const KeyRange& range, bool reverse)
+{
+  return reverse ? (long long) key - range.hi : (long long) range.lo - key;
+}
+
+RC IndexRangeScan::start()
+{
+  if (ranges.empty()) return 0;
+
+  // a list of single keys is looked up in one traversal of the B+tree
+  bool allPoints = tree != NULL && ranges.size() > 1;
+  for (unsigned i = 0; allPoints && i < ranges.size(); i++) {
+    allPoints = ranges[i].lo == ranges[i].hi;
+  }
+  if (allPoints) {
+    vector<int> keys(ranges.size());
+    for (unsigned i = 0; i < ranges.size(); i++) keys[i] = ranges[i].lo;
+    RC rc = tree->locateBatch(keys, points);
+    if (rc < 0) return rc;
+    if (reverse) std::reverse(points.begin(), points.end());
+    range = ranges.size();
+    return 0;
+  }
+
+  return locateRange();
+}
+
+// put the cursor on the first entry of the current range: the first one
+// at or above its start, or the last one at or below its end in reverse
+RC IndexRangeScan::locateRange()
+{
+  RC              rc;
+  const KeyRange& r = currentRange();
+  if (reverse) {
+    if (tree != NULL && tree->getTreeHeight() == 0) {
+      cursor.pid = -1;
+      return 0;
+    }
+    return tree != NULL ? tree->locateLast(r.hi, cursor) : resident->locateLast(r.hi, cursor);
+  }
+  rc = tree != NULL ? tree->locate(r.lo, cursor) : resident->locate(r.lo, cursor);
+  if (rc != 0) cursor.pid = -1;  // nothing found by locate; no results
+  return 0;
+}
+
+// read the entry at the cursor of whichever index is scanned, and move
+// the cursor to the next entry in the direction of the scan
+RC IndexRangeScan::readEntry(int& key, RecordId& rid)
+{
+  if (!reverse) {
+    if (tree != NULL) return tree->readForward(cursor, key, rid);
+    return resident->readForward(cursor, key, rid);
+  }
+
+  IndexCursor at = cursor;
+  RC          rc = tree != NULL ? tree->readForward(at, key, rid) : resident->readForward(at, key, rid);
+  if (rc != 0) return rc;
+
+  // the entry before it is in the same leaf, or the last one of the leaf
+  // before, found with another descent
+  if (cursor.eid > 0) {
+    cursor.eid--;
+  } else if (key == std::numeric_limits<int>::min()) {
+    cursor.pid = -1;
+  } else if (tree != NULL) {
+    return tree->locateLast(key - 1, cursor);
+  } else {
+    cursor.pid = -1;
+  }
+  return 0;
+}
+
+// find the next entry of the scan with a key in one of the ranges
+RC IndexRangeScan::nextEntry(int& key, RecordId& rid, bool& found)
+{
+  RC rc;
+
+  found = false;
+  if (pointNext < points.size()) {
+    key   = points[pointNext].key;
+    rid   = points[pointNext].rid;
+    found = true;
+    pointNext++;
+    return 0;
+  }
+
+  while (range < ranges.size() && cursor.pid != -1) {
+    if ((rc = readEntry(key, rid)) < 0) return rc;
+
+    // move on to the range the key is in or before
+    while (range < ranges.size() && (reverse ? key < currentRange().lo : key > currentRange().hi)) {
+      range++;
+    }
+    if (range == ranges.size()) return 0;
+
+    // a key in the gap before the range: read on if at most one more key
+    // can be in the way, and jump to the start of the range otherwise
+    if (distanceTo(key, currentRange(), reverse) > 0) {
+      if (distanceTo(key, currentRange(), reverse) > 2 && (rc = locateRange()) < 0) return rc;
+      continue;
+    }
+
+    // keys are unique in the index, so nothing of the range comes after
+    // its last key
+    if (key == (reverse ? currentRange().lo : currentRange().hi)) {
+      range++;
+      if (range < ranges.size() && distanceTo(key, currentRange(), reverse) > 2
+          && (rc = locateRange()) < 0) {
+        return rc;
+      }
+    }
+    found = true;
+    return 0;
+  }
+  return 0;
+}
+
+RC IndexRangeScan::fetchSorted()
+{
+  RC                 rc;
+  int                key;
+  RecordId           rid;
+  bool               found;
+  vector<IndexEntry> candidates;
+
+  // collect the rids of all ranges
+  while (numRead != limit) {
+    if ((rc = nextEntry(key, rid, found)) < 0) return rc;
+    if (!found) break;
+    IndexEntry candidate = {key, rid};
+    candidates.push_back(candidate);
+    numRead++;
+  }
+
+  // read the table in page order and put the tuples back in key order
+  vector<Tuple> tuples(candidates.size());
+  sort(candidates.begin(), candidates.end(), indexEntryRidLess);
+  for (unsigned i = 0; i < candidates.size(); i++) {
+    if ((rc = rf.read(candidates[i].rid, tuples[i].key, tuples[i].value)) < 0) return rc;
+  }
+  stable_sort(tuples.begin(), tuples.end(), tupleLess);
+  if (reverse) std::reverse(tuples.begin(), tuples.end());
+
+  for (unsigned i = 0; i < tuples.size(); i++) {
+    fetchedKeys.push_back(tuples[i].key);
+    fetchedValues.push_back(tuples[i].value);
+  }
+  return 0;
+}
+
+RC IndexRangeScan::next(TupleBatch& batch)
+{
+  RC       rc;
+  int      key;
+  RecordId rid;
+  bool     found;
+  string   value;
+
+  batch.clear();
+  if (!started) {
+    started = true;
+    if ((rc = start()) < 0) return rc;
+    if (sortedFetch && (rc = fetchSorted()) < 0) return rc;
+  }
+
+  if (sortedFetch) {
+    while (!batch.full() && fetchedNext < fetchedKeys.size()) {
+      batch.add(fetchedKeys[fetchedNext], fetchedValues[fetchedNext]);
+      fetchedNext++;
+    }
+    return 0;
+  }
+
+  while (!batch.full() && numRead != limit) {
+    if ((rc = nextEntry(key, rid, found)) < 0) return rc;
+    if (!found) break;
+    if (needValue && (rc = rf.read(rid, key, value)) < 0) return rc;
+    batch.add(key, value);
+    numRead++;
+  }
+  return 0;
+}
+
+
+KeyLookup::KeyLookup(HashIndex& index, RecordFile& rf, const vector<int>& keys, bool needValue)
+  : index(index), rf(rf), keys(keys), needValue(needValue), keyNext(0)
+{
+}
+
+RC KeyLookup::next(TupleBatch& batch)
+{
+  RC       rc;
+  RecordId rid;
+  int      foundKey;
+  string   value;
+
+  batch.clear();
+  while (!batch.full() && keyNext < keys.size()) {
+    foundKey = keys[keyNext++];
+    rc = index.locate(foundKey, rid);
+    if (rc == RC_NO_SUCH_RECORD) continue;
+    if (rc != 0) return rc;
+
+    if (needValue && (rc = rf.read(rid, foundKey, value)) < 0) return rc;
+    batch.add(foundKey, value);
+  }
+  return 0;
+}
+
+
+ClusteredScan::ClusteredScan(ClusteredIndex& index, int minKey, int maxKey)
+  : index(index), minKey(minKey), maxKey(maxKey), started(false)
+{
+}
+
+RC ClusteredScan::next(TupleBatch& batch)
+{
+  RC     rc;
+  int    key;
+  string value;
+
+  batch.clear();
+  if (!started) {
+    started = true;
+    if ((rc = index.locate(minKey, cursor)) < 0) return rc;
+  }
+
+  while (!batch.full() && cursor.pid != -1) {
+    if ((rc = index.readForward(cursor, key, value)) < 0) return rc;
+    if (key > maxKey) {
+      // past the max range
+      cursor.pid = -1;
+      break;
+    }
+    batch.add(key, value);
+  }
+  return 0;
+}
+
+
+ValueIndexScan::ValueIndexScan(ValueIndex& index, RecordFile& rf, bool loExists, const string& lo,
+                               bool hiExists, const string& hi)
+  : index(index), rf(rf), loExists(loExists), lo(lo), hiExists(hiExists), hi(hi), started(false)
+{
+}
+
+RC ValueIndexScan::next(TupleBatch& batch)
+{
+  RC         rc;
+  ValueEntry entry;
+  int        key;
+  string     value;
+
+  batch.clear();
+  if (!started) {
+    started = true;
+    if ((rc = index.locate(loExists ? lo : string(), cursor)) < 0) return rc;
+  }
+
+  while (!batch.full() && cursor.pid != -1) {
+    if ((rc = index.readForward(cursor, entry)) < 0) return rc;
+    if (hiExists && ValueIndex::comparePrefix(entry, hi) > 0) {
+      // past the prefix of the largest value in range
+      cursor.pid = -1;
+      break;
+    }
+
+    // the entry holds the whole value unless it was truncated
+    key = entry.key;
+    if (ValueIndex::isExact(entry)) {
+      value = ValueIndex::prefixOf(entry);
+    } else if ((rc = rf.read(entry.rid, key, value)) < 0) {
+      return rc;
+    }
+    batch.add(key, value);
+  }
+  return 0;
+}
+
+
+RC Filter::next(TupleBatch& batch)
+{
+  RC rc;
+
+  // keep pulling until some tuple of a batch matches, or the child ends
+  do {
+    if ((rc = child->next(batch)) < 0) return rc;
+    if (batch.count == 0) return 0;
+
+    int n = 0;
+    if (!batch.selective && pred.hasKeyConds()) {
+      n = pred.selectKeys(batch.keys, batch.count, batch.sel);
+    } else {
+      for (int i = 0; i < batch.size(); i++) {
+        int pos = batch.at(i);
+        if (pred.matchesKey(batch.keys[pos])) batch.sel[n++] = pos;
+      }
+    }
+
+    if (pred.hasValueConds()) {
+      int kept = 0;
+      for (int i = 0; i < n; i++) {
+        int pos = batch.sel[i];
+        if (pred.matchesValue(batch.keys[pos], batch.values[pos])) batch.sel[kept++] = pos;
+      }
+      n = kept;
+    }
+
+    batch.selective   = true;
+    batch.numSelected = n;
+  } while (batch.size() == 0);
+
+  return 0;
+}
+
+
+RC Project::next(TupleBatch& batch)
+{
+  RC rc;
+
+  if ((rc = child->next(batch)) < 0) return rc;
+  if (attr == 1) {
+    // only the keys are selected
+    for (int i = 0; i < batch.size(); i++) batch.values[batch.at(i)].clear();
+  }
+  return 0;
+}
+
+
+RC Count::next(TupleBatch& batch)
+{
+  RC         rc;
+  TupleBatch input;
+  int        count = 0;
+
+  batch.clear();
+  if (done) return 0;
+  done = true;
+
+  do {
+    if ((rc = child->next(input)) < 0) return rc;
+    count += input.size();
+  } while (input.size() > 0);
+
+  batch.add(count, string());
+  return 0;
+}
+
+
+RC Limit::next(TupleBatch& batch)
+{
+  RC rc;
+
+  batch.clear();
+  if (remaining == 0) return 0;
+
+  if ((rc = child->next(batch)) < 0) return rc;
+  if (batch.size() > remaining) {
+    if (batch.selective) batch.numSelected = remaining;
+    else batch.count = remaining;
+  }
+  remaining -= batch.size();
+  return 0;
+}
+
+
+bool Sort::Order::before(int aKey, const string& aValue, int aSeq,
+                         int bKey, const string& bValue, int bSeq) const
+{
+  int diff;
+  if (byValue) {
+    diff = aValue.compare(bValue);
+  } else {
+    diff = aKey < bKey ? -1 : (aKey > bKey ? 1 : 0);
+  }
+  if (diff != 0) return desc ? diff > 0 : diff < 0;
+  return aSeq < bSeq;
+}
+
+Sort::Sort(Operator* child, bool byValue, bool desc, int limit)
+  : child(child), limit(limit), started(false), bufferNext(0)
+{
+  order.byValue = byValue;
+  order.desc    = desc;
+}
+
+Sort::~Sort()
+{
+  for (unsigned i = 0; i < runs.size(); i++) fclose(runs[i]);
+  delete child;
+}
+
+// read all tuples of the child into the heap, or into sorted runs
+RC Sort::consume()
+{
+  RC         rc;
+  TupleBatch input;
+  int        seq = 0;
+
+  do {
+    if ((rc = child->next(input)) < 0) return rc;
+    for (int i = 0; i < input.size(); i++, seq++) {
+      int pos = input.at(i);
+      if (limit < 0) {
+        if (buffer.size() == (unsigned) RUN_TUPLES && (rc = spill()) < 0) return rc;
+        Entry entry = {input.keys[pos], input.values[pos], seq};
+        buffer.push_back(entry);
+      } else if (buffer.size() < (unsigned) limit) {
+        Entry entry = {input.keys[pos], input.values[pos], seq};
+        buffer.push_back(entry);
+        push_heap(buffer.begin(), buffer.end(), order);
+      } else if (limit > 0 && order.before(input.keys[pos], input.values[pos], seq,
+                                           buffer[0].key, buffer[0].value, buffer[0].seq)) {
+        // the tuple takes the place of the last one kept
+        pop_heap(buffer.begin(), buffer.end(), order);
+        buffer.back().key   = input.keys[pos];
+        buffer.back().value = input.values[pos];
+        buffer.back().seq   = seq;
+        push_heap(buffer.begin(), buffer.end(), order);
+      }
+    }
+  } while (input.size() > 0);
+
+  if (limit >= 0) {
+    sort_heap(buffer.begin(), buffer.end(), order);
+    return 0;
+  }
+
+  if (runs.empty()) {
+    sort(buffer.begin(), buffer.end(), order);
+    return 0;
+  }
+
+  // spill the last run too, and merge them all
+  if ((rc = spill()) < 0) return rc;
+  for (unsigned run = 0; run < runs.size(); run++) {
+    Head head;
+    bool found;
+    head.run = run;
+    if ((rc = readRun(run, head.entry, found)) < 0) return rc;
+    if (found) heads.push_back(head);
+  }
+  HeadOrder headOrder;
+  headOrder.order = order;
+  make_heap(heads.begin(), heads.end(), headOrder);
+  return 0;
+}
+
+// sort the tuples in the buffer and write them to a new run
+RC Sort::spill()
+{
+  FILE* run = tmpfile();
+  if (run == NULL) return RC_FILE_OPEN_FAILED;
+  runs.push_back(run);
+
+  sort(buffer.begin(), buffer.end(), order);
+  for (unsigned i = 0; i < buffer.size(); i++) {
+    int header[3] = {buffer[i].key, buffer[i].seq, (int) buffer[i].value.size()};
+    if (fwrite(header, sizeof(header), 1, run) != 1 ||
+        fwrite(buffer[i].value.data(), 1, header[2], run) != (size_t) header[2]) {
+      return RC_FILE_WRITE_FAILED;
+    }
+  }
+  if (fflush(run) != 0 || fseek(run, 0, SEEK_SET) != 0) return RC_FILE_WRITE_FAILED;
+  buffer.clear();
+  return 0;
+}
+
+// read the next tuple of a spilled run
+RC Sort::readRun(int run, Entry& entry, bool& found)
+{
+  int header[3];
+
+  found = false;
+  if (fread(header, sizeof(header), 1, runs[run]) != 1) {
+    return feof(runs[run]) ? 0 : RC_FILE_READ_FAILED;
+  }
+  entry.key = header[0];
+  entry.seq = header[1];
+  entry.value.resize(header[2]);
+  if (header[2] > 0 && fread(&entry.value[0], 1, header[2], runs[run]) != (size_t) header[2]) {
+    return RC_FILE_READ_FAILED;
+  }
+  found = true;
+  return 0;
+}
+
+RC Sort::next(TupleBatch& batch)
+{
+  RC rc;
+
+  batch.clear();
+  if (!started) {
+    started = true;
+    if ((rc = consume()) < 0) return rc;
+  }
+
+  if (runs.empty()) {
+    while (!batch.full() && bufferNext < buffer.size()) {
+      batch.add(buffer[bufferNext].key, buffer[bufferNext].value);
+      bufferNext++;
+    }
+    return 0;
+  }
+
+  // take the first of the run heads, and replace it with the next tuple
+  // of its run
+  HeadOrder headOrder;
+  headOrder.order = order;
+  while (!batch.full() && !heads.empty()) {
+    pop_heap(heads.begin(), heads.end(), headOrder);
+    Head& head = heads.back();
+    batch.add(head.entry.key, head.entry.value);
+
+    bool found;
+    if ((rc = readRun(head.run, head.entry, found)) < 0) return rc;
+    if (found) push_heap(heads.begin(), heads.end(), headOrder);
+    else heads.pop_back();
+  }
+  return 0;
+}
+
+
+RC Aggregate::next(TupleBatch& batch)
+{
+  RC         rc;
+  TupleBatch input;
+  int        count = 0;
+  int        key   = 0;      // the smallest or largest key so far
+  long long  sum   = 0;
+  string     value;          // the smallest or largest value so far
+
+  batch.clear();
+  if (done) return 0;
+  done = true;
+
+  do {
+    if ((rc = child->next(input)) < 0) return rc;
+    int n = input.size();
+    if (n == 0) break;
+
+    int first = 0;
+    if (count == 0) {
+      key   = input.keys[input.at(0)];
+      value = input.values[input.at(0)];
+      first = 1;
+    }
+    switch (attr) {
+      case 5:
+        for (int i = first; i < n; i++) key = std::min(key, input.keys[input.at(i)]);
+        break;
+      case 6:
+        for (int i = first; i < n; i++) key = std::max(key, input.keys[input.at(i)]);
+        break;
+      case 7:
+      case 8:
+        for (int i = 0; i < n; i++) sum += input.keys[input.at(i)];
+        break;
+      case 9:
+        for (int i = first; i < n; i++) {
+          if (input.values[input.at(i)] < value) value = input.values[input.at(i)];
+        }
+        break;
+      case 10:
+        for (int i = first; i < n; i++) {
+          if (input.values[input.at(i)] > value) value = input.values[input.at(i)];
+        }
+        break;
+    }
+    count += n;
+  } while (true);
+
+  char text[32];
+  if (count == 0) {
+    batch.add(0, "NULL");
+    return 0;
+  }
+  switch (attr) {
+    case 5:
+    case 6:
+      sprintf(text, "%d", key);
+      value = text;
+      break;
+    case 7:
+      sprintf(text, "%lld", sum);
+      value = text;
+      break;
+    case 8:
+      sprintf(text, "%.15g", (double) sum / count);
+      value = text;
+      break;
+  }
+  batch.add(0, value);
+  return 0;
+}
+
+
+// the size of the arena blocks the group values are copied into
+static const int ARENA_BLOCK = 65536;
+
+HashAggregate::HashAggregate(Operator* child)
+  : child(child), started(false), spilled(0), slotNext(0), blockUsed(ARENA_BLOCK), depth(0)
+{
+  clearTable();
+}
+
+HashAggregate::~HashAggregate()
+{
+  clearTable();
+  for (unsigned i = 0; i < parts.size(); i++) {
+    if (parts[i] != NULL) fclose(parts[i]);
+  }
+  for (unsigned i = 0; i < pending.size(); i++) fclose(pending[i].file);
+  delete child;
+}
+
+// FNV-1a, seeded with the level so that a partition that spills again
+// splits its groups differently, and mixed for the low bits of the slot
+unsigned HashAggregate::hashOf(const char* value, int length) const
+{
+  unsigned hash = 2166136261u ^ ((unsigned) depth * 0x9e3779b1u);
+  for (int i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char) value[i]) * 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+// copy a value into the arena
+const char* HashAggregate::store(const char* value, int length)
+{
+  if (length > ARENA_BLOCK) {
+    // a block of its own; the last block stays full
+    char* block = new char[length];
+    blocks.push_back(block);
+    blockUsed = ARENA_BLOCK;
+    memcpy(block, value, length);
+    return block;
+  }
+  if (blocks.empty() || blockUsed + length > ARENA_BLOCK) {
+    blocks.push_back(new char[ARENA_BLOCK]);
+    blockUsed = 0;
+  }
+  char* copy = blocks.back() + blockUsed;
+  memcpy(copy, value, length);
+  blockUsed += length;
+  return copy;
+}
+
+// double the number of slots, keeping the table at most half full
+void HashAggregate::grow()
+{
+  vector<Slot> old;
+  old.swap(slots);
+  Slot empty = {0, 0, NULL, 0};
+  slots.assign(old.size() * 2, empty);
+
+  unsigned mask = slots.size() - 1;
+  for (unsigned i = 0; i < old.size(); i++) {
+    if (old[i].count == 0) continue;
+    unsigned s = old[i].hash & mask;
+    while (slots[s].count != 0) s = (s + 1) & mask;
+    slots[s] = old[i];
+  }
+}
+
+// empty the table and free the arena
+void HashAggregate::clearTable()
+{
+  for (unsigned i = 0; i < blocks.size(); i++) delete [] blocks[i];
+  blocks.clear();
+  blockUsed = ARENA_BLOCK;
+
+  Slot empty = {0, 0, NULL, 0};
+  slots.assign(1024, empty);
+  groups = 0;
+  slotNext = 0;
+}
+
+// count count tuples of the group of a value, or spill them if the group
+// is not in the table and the table is full
+RC HashAggregate::add(const char* value, int length, int count)
+{
+  unsigned hash = hashOf(value, length);
+  unsigned mask = slots.size() - 1;
+  unsigned s = hash & mask;
+
+  for (; slots[s].count != 0; s = (s + 1) & mask) {
+    Slot& slot = slots[s];
+    if (slot.hash == hash && slot.length == length && memcmp(slot.value, value, length) == 0) {
+      slot.count += count;
+      return 0;
+    }
+  }
+
+  if (groups >= MEMORY_GROUPS && depth < MAX_DEPTH) {
+    if (parts.empty()) parts.assign(PARTITIONS, (FILE*) NULL);
+    FILE*& part = parts[(hash >> 24) % PARTITIONS];
+    if (part == NULL && (part = tmpfile()) == NULL) return RC_FILE_OPEN_FAILED;
+    int header[2] = {count, length};
+    if (fwrite(header, sizeof(header), 1, part) != 1 ||
+        fwrite(value, 1, length, part) != (size_t) length) {
+      return RC_FILE_WRITE_FAILED;
+    }
+    spilled++;
+    return 0;
+  }
+
+  Slot slot = {hash, count, store(value, length), length};
+  slots[s] = slot;
+  if (2 * ++groups > (int) slots.size()) grow();
+  return 0;
+}
+
+// queue the partitions spilled while grouping the last input
+RC HashAggregate::finishPass()
+{
+  for (unsigned i = 0; i < parts.size(); i++) {
+    if (parts[i] == NULL) continue;
+    if (fflush(parts[i]) != 0 || fseek(parts[i], 0, SEEK_SET) != 0) return RC_FILE_WRITE_FAILED;
+    Partition partition = {parts[i], depth + 1};
+    pending.push_back(partition);
+  }
+  parts.clear();
+  return 0;
+}
+
+// group all tuples of the child
+RC HashAggregate::consume()
+{
+  RC         rc;
+  TupleBatch input;
+
+  do {
+    if ((rc = child->next(input)) < 0) return rc;
+    for (int i = 0; i < input.size(); i++) {
+      const string& value = input.values[input.at(i)];
+      if ((rc = add(value.data(), value.size(), 1)) < 0) return rc;
+    }
+  } while (input.size() > 0);
+
+  return finishPass();
+}
+
+// group the tuples of the next spilled partition
+RC HashAggregate::loadPartition()
+{
+  RC     rc;
+  string value;
+  int    header[2];
+
+  Partition partition = pending.back();
+  pending.pop_back();
+  clearTable();
+  depth = partition.depth;
+
+  while (fread(header, sizeof(header), 1, partition.file) == 1) {
+    value.resize(header[1]);
+    if (header[1] > 0 && fread(&value[0], 1, header[1], partition.file) != (size_t) header[1]) {
+      fclose(partition.file);
+      return RC_FILE_READ_FAILED;
+    }
+    if ((rc = add(value.data(), value.size(), header[0])) < 0) {
+      fclose(partition.file);
+      return rc;
+    }
+  }
+  rc = ferror(partition.file) ? RC_FILE_READ_FAILED : 0;
+  fclose(partition.file);
+  if (rc < 0) return rc;
+
+  return finishPass();
+}
+
+RC HashAggregate::next(TupleBatch& batch)
+{
+  RC rc;
+
+  batch.clear();
+  if (!started) {
+    started = true;
+    if ((rc = consume()) < 0) return rc;
+  }
+
+  while (!batch.full()) {
+    for (; !batch.full() && slotNext < slots.size(); slotNext++) {
+      const Slot& slot = slots[slotNext];
+      if (slot.count == 0) continue;
+      batch.keys[batch.count] = slot.count;
+      batch.values[batch.count++].assign(slot.value, slot.length);
+    }
+    if (slotNext < slots.size() || pending.empty()) break;
+    if ((rc = loadPartition()) < 0) return rc;
+  }
+  return 0;
+}
+
+RC Output::next(TupleBatch& batch)
+{
+  RC rc;
+
+  if ((rc = child->next(batch)) < 0) return rc;
+  for (int i = 0; i < batch.size(); i++) {
+    int pos = batch.at(i);
+    switch (attr) {
+      case 1:  // SELECT key
+      case 4:  // SELECT COUNT(*)
+        fprintf(stdout, "%d\n", batch.keys[pos]);
+        break;
+      case 2:  // SELECT value
+        fprintf(stdout, "%s\n", batch.values[pos].c_str());
+        break;
+      case 3:  // SELECT *
+        fprintf(stdout, "%d '%s'\n", batch.keys[pos], batch.values[pos].c_str());
+        break;
+      case 11:  // SELECT value, COUNT(*) ... GROUP BY value
+        fprintf(stdout, "'%s' %d\n", batch.values[pos].c_str(), batch.keys[pos]);
+        break;
+      default:  // SELECT MIN(key), ..., MAX(value), or value ... GROUP BY value
+        fprintf(stdout, "%s\n", batch.values[pos].c_str());
+        break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef OPERATOR_H
+#define OPERATOR_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "SqlEngine.h"
+#include "Predicate.h"
+#include "WorkerPool.h"
+
+class ArtIndex;
+class HashIndex;
+class ValueIndex;
+class ClusteredIndex;
+
+/**
+ * A batch of tuples passed from one operator to the next.
+ * values[i] is only filled in when the operator that produced the batch
+ * was asked for the values. The slots are reused from batch to batch,
+ * so the strings keep their buffers.
+ * A filter does not move the tuples it keeps; it lists their positions
+ * in the selection vector sel instead, and the operators above it only
+ * look at the selected tuples: the i'th of them is at position at(i).
+ */
+struct TupleBatch {
+  /// the number of tuples an operator puts into a batch
+  static const int CAPACITY = 256;
+
+  int         count;             // the number of tuples in the batch
+  int         keys[CAPACITY];
+  std::string values[CAPACITY];
+
+  bool        selective;         // whether only the tuples in sel count
+  int         numSelected;       // the number of positions in sel
+  int         sel[CAPACITY];     // the positions of the selected tuples
+
+  TupleBatch() : count(0), selective(false), numSelected(0) {}
+
+  int  size() const     { return selective ? numSelected : count; }
+  int  at(int i) const  { return selective ? sel[i] : i; }
+  bool full() const     { return count == CAPACITY; }
+  void clear()          { count = 0; selective = false; }
+  void add(int key, const std::string& value)
+  {
+    keys[count] = key;
+    values[count++] = value;
+  }
+};
+
+/**
+ * An operator of a query plan. A plan is a tree of operators; the root
+ * pulls batches of tuples out of its children with next(), which pull
+ * from theirs in turn, down to the operators reading the table.
+ * Unary operators own their child and delete it when they are deleted.
+ */
+class Operator {
+ public:
+  virtual ~Operator() {}
+
+  /**
+   * produce the next batch of tuples.
+   * @param batch[OUT] the tuples; it is empty when there are no more
+   * @return error code. 0 if no error
+   */
+  virtual RC next(TupleBatch& batch) = 0;
+};
+
+/**
+ * Read a table in page order. When the key ranges of the predicate do
+ * not cover all keys, pages whose zone map range falls outside of all of
+ * them are skipped; the tuples of the other pages are all passed on, in
+ * or out of range.
+ */
+class TableScan : public Operator {
+ public:
+  TableScan(RecordFile& rf, const Predicate& pred, bool prune);
+  RC next(TupleBatch& batch);
+
+ private:
+  RecordFile&      rf;
+  RecordId         rid;     // the next tuple to read
+  const Predicate& pred;
+  bool             prune;   // whether to skip pages with the zone map
+};
+
+/**
+ * Read a table with several worker threads and filter it on the way.
+ * The pages are split into morsels of MORSEL_PAGES pages, run by a
+ * WorkerPool; every worker prunes, reads and filters the pages of the
+ * morsels it takes with its own cursor, and keeps the tuples that meet
+ * the conditions with the morsel. next() passes them on morsel by morsel,
+ * so they come out in page order, as from a TableScan and a Filter. The
+ * workers keep at most a few morsels per worker ahead of next().
+ * With countOnly, only the number of matching tuples is kept, and the
+ * single batch produced holds the total as the key of one tuple, as the
+ * batch of Count does.
+ */
+class ParallelScan : public Operator, private MorselTask {
+ public:
+  /// the number of pages in a morsel
+  static const int MORSEL_PAGES = 64;
+
+  /**
+   * @param prune[IN] whether to skip pages with the zone map
+   * @param needValue[IN] whether to read the values of the tuples
+   * @param numWorkers[IN] the number of worker threads
+   */
+  ParallelScan(RecordFile& rf, const Predicate& pred, bool prune, bool needValue,
+               bool countOnly, int numWorkers);
+  ~ParallelScan();
+  RC next(TupleBatch& batch);
+
+ private:
+  // the result of one morsel
+  struct Morsel {
+    RC                       rc;
+    int                      count;
+    std::vector<int>         keys;
+    std::vector<std::string> values;
+  };
+
+  RC   startWorkers();
+  void run(int morsel);
+  RC   scanMorsel(int morsel, Morsel& result);
+
+  RecordFile&      rf;
+  const Predicate& pred;
+  bool             prune;
+  bool             needValue;
+  bool             countOnly;
+  int              numWorkers;
+  int              numPages;
+
+  WorkerPool          pool;
+  bool                started;
+  std::vector<Morsel> morsels;
+  int                 current;      // the morsel next() is passing on
+  unsigned            currentNext;  // the next tuple of it to pass on
+};
+
+/**
+ * Read the entries with keys in a sorted list of disjoint key ranges from
+ * a B+tree or a memory-resident index, and the tuples they point to if
+ * the values are needed. The tuples come out in key order.
+ * The scan reads along the leaves through a range and on into the next
+ * one when it starts right after; otherwise it jumps to the start of the
+ * next range with locate(). When every range is a single key, the B+tree
+ * looks them all up with one locateBatch() traversal instead.
+ * With sortedFetch, the rids of the whole range are collected first and
+ * the table is read in page order, so every page is read once; the
+ * tuples are then put back in key order.
+ * With reverse, the range is read from maxKey down to minKey: the leaves
+ * are only linked forward, so the scan steps back within a leaf and
+ * descends again from the root for the leaf before it.
+ */
+class IndexRangeScan : public Operator {
+ public:
+  /**
+   * @param tree[IN] the B+tree, or NULL to use resident
+   * @param resident[IN] the memory-resident index, used when tree is NULL
+   * @param rf[IN] the table, read only when needValue is set
+   * @param reverse[IN] whether to read the range in descending key order
+   * @param limit[IN] the number of entries to read at most, -1 for all
+   */
+  IndexRangeScan(BTreeIndex* tree, const ArtIndex* resident, RecordFile& rf,
+                 const std::vector<KeyRange>& ranges, bool needValue, bool sortedFetch,
+                 bool reverse = false, int limit = -1);
+  RC next(TupleBatch& batch);
+
+ private:
+  const KeyRange& currentRange() const;
+  RC start();
+  RC locateRange();
+  RC readEntry(int& key, RecordId& rid);
+  RC nextEntry(int& key, RecordId& rid, bool& found);
+  RC fetchSorted();
+
+  BTreeIndex*           tree;
+  const ArtIndex*       resident;
+  RecordFile&           rf;
+  std::vector<KeyRange> ranges;
+  bool                  needValue;
+  bool                  sortedFetch;
+  bool                  reverse;
+  int                   limit;
+
+  bool               started;  // whether the cursor has been located
+  unsigned           range;    // the number of ranges passed, in scan order
+  int                numRead;  // the number of entries read so far
+  IndexCursor        cursor;
+  std::vector<IndexEntry>  points;         // the entries locateBatch() found
+  unsigned                 pointNext;      // the next one to pass on
+  std::vector<int>         fetchedKeys;    // the tuples read by
+  std::vector<std::string> fetchedValues;  // fetchSorted(), in key order
+  unsigned                 fetchedNext;    // the next one to pass on
+};
+
+/**
+ * Look up a sorted list of keys in a hash index, one at a time.
+ */
+class KeyLookup : public Operator {
+ public:
+  KeyLookup(HashIndex& index, RecordFile& rf, const std::vector<int>& keys, bool needValue);
+  RC next(TupleBatch& batch);
+
+ private:
+  HashIndex&       index;
+  RecordFile&      rf;
+  std::vector<int> keys;
+  bool             needValue;
+  unsigned         keyNext;  // the next key to look up
+};
+
+/**
+ * Walk the leaves of a clustered table from minKey up to maxKey.
+ */
+class ClusteredScan : public Operator {
+ public:
+  ClusteredScan(ClusteredIndex& index, int minKey, int maxKey);
+  RC next(TupleBatch& batch);
+
+ private:
+  ClusteredIndex& index;
+  int             minKey;
+  int             maxKey;
+  bool            started;
+  IndexCursor     cursor;
+};
+
+/**
+ * Read the entries of the value index from the prefix of lo (or the
+ * start) up to the prefix of hi (or the end), fetching the tuples whose
+ * values are longer than the prefix.
+ */
+class ValueIndexScan : public Operator {
+ public:
+  ValueIndexScan(ValueIndex& index, RecordFile& rf, bool loExists, const std::string& lo,
+                 bool hiExists, const std::string& hi);
+  RC next(TupleBatch& batch);
+
+ private:
+  ValueIndex& index;
+  RecordFile& rf;
+  bool        loExists;
+  std::string lo;
+  bool        hiExists;
+  std::string hi;
+  bool        started;
+  IndexCursor cursor;
+};
+
+/**
+ * Pass on the tuples that meet all conditions of the WHERE clause.
+ * The key conditions are checked over the whole batch at once with
+ * Predicate::selectKeys(), and the value conditions on the tuples
+ * left; the result is the selection vector of the batch.
+ */
+class Filter : public Operator {
+ public:
+  Filter(Operator* child, const Predicate& pred) : child(child), pred(pred) {}
+  ~Filter() { delete child; }
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator*        child;
+  const Predicate& pred;
+};
+
+/**
+ * Keep the attribute in the SELECT clause (1: key, 2: value, 3: *).
+ * The values are dropped when only the keys are selected.
+ */
+class Project : public Operator {
+ public:
+  Project(Operator* child, int attr) : child(child), attr(attr) {}
+  ~Project() { delete child; }
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator* child;
+  int       attr;
+};
+
+/**
+ * Count the tuples of the child. The single batch it produces holds the
+ * count as the key of one tuple.
+ */
+class Count : public Operator {
+ public:
+  Count(Operator* child) : child(child), done(false) {}
+  ~Count() { delete child; }
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator* child;
+  bool      done;
+};
+
+/**
+ * Pass on the first limit tuples of the child, and stop pulling from it
+ * once they have been passed on.
+ */
+class Limit : public Operator {
+ public:
+  Limit(Operator* child, int limit) : child(child), remaining(limit) {}
+  ~Limit() { delete child; }
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator* child;
+  int       remaining;  // the number of tuples still to pass on
+};
+
+/**
+ * Sort the tuples of the child on the key or the value, ascending or
+ * descending; tuples that tie keep the order they came in.
+ * With a limit, only the first limit tuples of the order are kept, in a
+ * heap whose top is the last of them, so the memory used is bounded by
+ * the limit. Without one, the tuples are sorted in runs of RUN_TUPLES;
+ * when there is more than one run, each is spilled to a temporary file
+ * and the runs are merged as the tuples are passed on.
+ */
+class Sort : public Operator {
+ public:
+  /// the number of tuples sorted in memory at a time
+  static const int RUN_TUPLES = 65536;
+
+  /**
+   * @param byValue[IN] whether to sort on the value instead of the key
+   * @param desc[IN] whether to sort in descending order
+   * @param limit[IN] the number of tuples to keep, -1 for all
+   */
+  Sort(Operator* child, bool byValue, bool desc, int limit);
+  ~Sort();
+  RC next(TupleBatch& batch);
+
+ private:
+  // a tuple and its position in the input, which breaks ties
+  struct Entry {
+    int         key;
+    std::string value;
+    int         seq;
+  };
+
+  // the order of the tuples: true if a comes before b
+  struct Order {
+    bool byValue;
+    bool desc;
+    bool before(int aKey, const std::string& aValue, int aSeq,
+                int bKey, const std::string& bValue, int bSeq) const;
+    bool operator()(const Entry& a, const Entry& b) const
+    {
+      return before(a.key, a.value, a.seq, b.key, b.value, b.seq);
+    }
+  };
+
+  // the next tuple of every run in the merge, and the run it is from
+  struct Head {
+    Entry entry;
+    int   run;
+  };
+
+  // puts the head that comes first on top of a heap
+  struct HeadOrder {
+    Order order;
+    bool operator()(const Head& a, const Head& b) const { return order(b.entry, a.entry); }
+  };
+
+  RC consume();
+  RC spill();
+  RC readRun(int run, Entry& entry, bool& found);
+
+  Operator*          child;
+  Order              order;
+  int                limit;
+  bool               started;
+  std::vector<Entry> buffer;   // the heap, or the run being sorted
+  unsigned           bufferNext;
+  std::vector<FILE*> runs;     // the spilled runs
+  std::vector<Head>  heads;    // a heap of the next tuple of every run
+};
+
+/**
+ * Compute an aggregate over the tuples of the child (5: MIN(key),
+ * 6: MAX(key), 7: SUM(key), 8: AVG(key), 9: MIN(value), 10: MAX(value)).
+ * The single batch it produces holds the result, printed as text, as the
+ * value of one tuple; the result over no tuples is NULL.
+ */
+class Aggregate : public Operator {
+ public:
+  Aggregate(Operator* child, int attr) : child(child), attr(attr), done(false) {}
+  ~Aggregate() { delete child; }
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator* child;
+  int       attr;
+  bool      done;
+};
+
+/**
+ * Group the tuples of the child by value, and produce one tuple per
+ * group: the value, with the number of tuples in the group as the key.
+ * The groups are counted in an open-addressing hash table with linear
+ * probing; a slot holds the hash and the count of its group and points
+ * at the value, which is copied into an arena of large blocks.
+ * Once the table holds MEMORY_GROUPS groups, the tuples of groups not in
+ * it are written to one of PARTITIONS temporary files by hash, and the
+ * groups in the table go on counting. Each partition is grouped on its
+ * own after the table is passed on, with a new hash, spilling again if
+ * it still holds too many groups; past MAX_DEPTH levels the table grows
+ * instead.
+ */
+class HashAggregate : public Operator {
+ public:
+  /// the number of groups counted in memory at a time
+  static const int MEMORY_GROUPS = 65536;
+
+  /// the number of partitions the tuples of other groups are split into
+  static const int PARTITIONS = 16;
+
+  /// the number of times the groups of a partition are split again
+  static const int MAX_DEPTH = 4;
+
+  HashAggregate(Operator* child);
+  ~HashAggregate();
+  RC next(TupleBatch& batch);
+
+  /**
+   * @return the number of tuples written to the partition files
+   */
+  int getSpilledTuples() const { return spilled; }
+
+ private:
+  // a group in the table; count is 0 in an empty slot
+  struct Slot {
+    unsigned    hash;
+    int         count;
+    const char* value;
+    int         length;
+  };
+
+  // a spilled partition waiting to be grouped, and its level
+  struct Partition {
+    FILE* file;
+    int   depth;
+  };
+
+  RC consume();
+  RC add(const char* value, int length, int count);
+  RC finishPass();
+  RC loadPartition();
+  unsigned hashOf(const char* value, int length) const;
+  const char* store(const char* value, int length);
+  void grow();
+  void clearTable();
+
+  Operator*              child;
+  bool                   started;
+  int                    spilled;
+
+  // the hash table, its number of groups, and the next slot to pass on
+  std::vector<Slot>      slots;
+  int                    groups;
+  unsigned               slotNext;
+
+  // the arena blocks holding the values, and the space used in the last
+  std::vector<char*>     blocks;
+  int                    blockUsed;
+
+  // the level of the tuples being grouped, their partition files, and
+  // the partitions left to group
+  int                    depth;
+  std::vector<FILE*>     parts;
+  std::vector<Partition> pending;
+};
+
+/**
+ * Print every tuple of the child for the attribute in the SELECT clause
+ * (1: key, 2: value, 3: *, 4: count(*), 5-10: an aggregate, 11: value and
+ * count(*) of a group, 12: the value of a group), and pass the batches on.
+ */
+class Output : public Operator {
+ public:
+  Output(Operator* child, int attr) : child(child), attr(attr) {}
+  ~Output() { delete child; }
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator* child;
+  int       attr;
+};
+
+#endif // OPERATOR_H
@@ -18,6 +18,7 @@ int PageFile::readCount = 0;
 int PageFile::writeCount = 0;
 int PageFile::cacheClock = 1;
 struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+pthread_mutex_t PageFile::cacheLock = PTHREAD_MUTEX_INITIALIZER;
 
 PageFile::PageFile() 
 { 
@@ -74,6 +75,7 @@ RC PageFile::close()
   if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
   // evict all cached pages for this file
+  pthread_mutex_lock(&cacheLock);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
        readCache[i].fd = 0;
@@ -81,6 +83,7 @@ RC PageFile::close()
        readCache[i].lastAccessed = 0;
     }
   }
+  pthread_mutex_unlock(&cacheLock);
 
   // set the fd and epid to the initial state
   fd = -1; 
@@ -110,6 +113,7 @@ RC PageFile::write(PageId pid, const void* buffer)
   if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
 
   // if the page is in read cache, invalidate it
+  pthread_mutex_lock(&cacheLock);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid &&
         readCache[i].lastAccessed != 0) {
@@ -125,35 +129,46 @@ RC PageFile::write(PageId pid, const void* buffer)
 
   // increase page write count
   writeCount++;
+  pthread_mutex_unlock(&cacheLock);
 
   return 0;
 }
 
 RC PageFile::read(PageId pid, void* buffer) const
 {
-  RC rc;
-
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
   //
   // if the page is in cache, read it from there
   //
+  pthread_mutex_lock(&cacheLock);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid && 
         readCache[i].lastAccessed != 0) {
        memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
        readCache[i].lastAccessed = ++cacheClock;
+       pthread_mutex_unlock(&cacheLock);
        return 0;
     }
   }
+  pthread_mutex_unlock(&cacheLock);
 
-  // seek to the page
-  if ((rc = seek(pid) < 0)) return rc;
-  
-  // find the cache slot to evict
+  // read the page at its offset. pread() leaves the file cursor alone,
+  // so threads reading other pages of the file do not get in the way,
+  // and the lock is not held while waiting for the disk.
+  if (::pread(fd, buffer, PAGE_SIZE, (off_t)pid * PAGE_SIZE) < PAGE_SIZE) {
+    return RC_FILE_READ_FAILED;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+
+  // find the cache slot to evict: the one holding the page if another
+  // thread has cached it in the meantime, otherwise an empty one or the
+  // least recently used one (an empty slot has lastAccessed == 0)
   int toEvict = 0; 
   for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
+    if (readCache[i].fd == fd && readCache[i].pid == pid &&
+        readCache[i].lastAccessed != 0) {
       toEvict = i;
       break;
     }
@@ -164,15 +179,12 @@ RC PageFile::read(PageId pid, void* buffer) const
   readCache[toEvict].fd = fd;
   readCache[toEvict].pid = pid;
   readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
-  }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
+  memcpy(readCache[toEvict].buffer, buffer, PAGE_SIZE);
 
   // increase the page read count
   readCount++;
 
+  pthread_mutex_unlock(&cacheLock);
+
   return 0;
 }
@@ -11,12 +11,17 @@
 #define PAGEFILE_H
 
 #include <string>
+#include <pthread.h>
 #include "Bruinbase.h"
 
 typedef int PageId;
 
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * several threads may read the same PageFile at once: the read cache
+ * is shared by all PageFiles and guarded by a lock, and pages are read
+ * at their offset without moving the file cursor. writing is still meant
+ * for a single thread.
  */
 class PageFile {
  public:
@@ -105,6 +110,8 @@ class PageFile {
     char buffer[PAGE_SIZE]; // the buffer used for caching
   } readCache[CACHE_COUNT];
 
+  static pthread_mutex_t cacheLock;  // guards the cache and the counters
+
   static int readCount;  // total # of page reads 
   static int writeCount; // total # of page writes 
 };
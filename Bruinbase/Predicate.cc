@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include "Predicate.h"
+
+// defining NO_AVX2 leaves the AVX2 kernels out, e.g. to time the scalar ones
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_AVX2)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+// the number of key ranges up to which they are compared with every key
+// in the AVX2 kernel; more ranges are binary searched
+static const int MAX_VECTOR_RANGES = 8;
+
+using std::string;
+using std::vector;
+
+static bool keyRangeLess(const KeyRange& a, const KeyRange& b)
+{
+  return a.lo < b.lo;
+}
+
+// select the keys from position first on that are in [minKey, maxKey]
+// and not excluded. every position is written to sel, but the count only
+// moves past the matching ones, so there is no data-dependent branch.
+static int selectKeysScalar(const int* keys, int first, int n, int minKey, int maxKey,
+                            const int* excluded, int numExcluded, int* sel)
+{
+  int count = 0;
+  for (int i = first; i < n; i++) {
+    int  key  = keys[i];
+    bool keep = (key >= minKey) & (key <= maxKey);
+    for (int j = 0; j < numExcluded; j++) keep &= key != excluded[j];
+    sel[count] = i;
+    count += keep;
+  }
+  return count;
+}
+
+// select the keys from position first on that are in one of the sorted,
+// disjoint ranges. the binary search for the last range starting at or
+// below each key moves with conditional moves, not branches.
+static int selectRangesScalar(const int* keys, int first, int n, const KeyRange* ranges,
+                              int numRanges, int* sel)
+{
+  int count = 0;
+  for (int i = first; i < n; i++) {
+    int key = keys[i];
+    int lo  = 0;
+    for (int len = numRanges; len > 1; len -= len / 2) {
+      int half = len / 2;
+      lo = ranges[lo + half].lo <= key ? lo + half : lo;
+    }
+    bool keep = (key >= ranges[lo].lo) & (key <= ranges[lo].hi);
+    sel[count] = i;
+    count += keep;
+  }
+  return count;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+// for every 8-bit mask, the positions of its set bits, lowest first
+static int keepPositions[256][8];
+
+static bool initKeepPositions()
+{
+  for (int mask = 0; mask < 256; mask++) {
+    int n = 0;
+    for (int bit = 0; bit < 8; bit++) {
+      if (mask & (1 << bit)) keepPositions[mask][n++] = bit;
+    }
+  }
+  return true;
+}
+
+// the same, eight keys per compare. the compares give a mask of the keys
+// to keep; their positions are moved to the front of a vector with one
+// permute and stored together, so there is no branch per key here either.
+__attribute__((target("avx2")))
+static int selectKeysAvx2(const int* keys, int n, int minKey, int maxKey,
+                          const int* excluded, int numExcluded, int* sel)
+{
+  static const bool ready = initKeepPositions();
+  (void) ready;
+
+  const __m256i lo    = _mm256_set1_epi32(minKey);
+  const __m256i hi    = _mm256_set1_epi32(maxKey);
+  const __m256i step  = _mm256_set1_epi32(8);
+  __m256i       pos   = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  int           count = 0;
+  int           i     = 0;
+
+  // count never passes i, so the eight positions stored at sel + count
+  // stay within the first n of sel
+  for (; i + 8 <= n; i += 8) {
+    __m256i k    = _mm256_loadu_si256((const __m256i*) (keys + i));
+    __m256i drop = _mm256_or_si256(_mm256_cmpgt_epi32(lo, k), _mm256_cmpgt_epi32(k, hi));
+    for (int j = 0; j < numExcluded; j++) {
+      drop = _mm256_or_si256(drop, _mm256_cmpeq_epi32(k, _mm256_set1_epi32(excluded[j])));
+    }
+    unsigned keep = ~_mm256_movemask_ps(_mm256_castsi256_ps(drop)) & 0xff;
+    __m256i  perm = _mm256_loadu_si256((const __m256i*) keepPositions[keep]);
+    _mm256_storeu_si256((__m256i*) (sel + count), _mm256_permutevar8x32_epi32(pos, perm));
+    count += __builtin_popcount(keep);
+    pos = _mm256_add_epi32(pos, step);
+  }
+
+  // the last few keys
+  return count + selectKeysScalar(keys, i, n, minKey, maxKey, excluded, numExcluded, sel + count);
+}
+
+// the same for a few ranges, eight keys at a time: a key is dropped when
+// it is outside of every range
+__attribute__((target("avx2")))
+static int selectRangesAvx2(const int* keys, int n, const KeyRange* ranges, int numRanges,
+                            int* sel)
+{
+  static const bool ready = initKeepPositions();
+  (void) ready;
+
+  __m256i lo[MAX_VECTOR_RANGES];
+  __m256i hi[MAX_VECTOR_RANGES];
+  for (int j = 0; j < numRanges; j++) {
+    lo[j] = _mm256_set1_epi32(ranges[j].lo);
+    hi[j] = _mm256_set1_epi32(ranges[j].hi);
+  }
+
+  const __m256i step  = _mm256_set1_epi32(8);
+  __m256i       pos   = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  int           count = 0;
+  int           i     = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i k    = _mm256_loadu_si256((const __m256i*) (keys + i));
+    __m256i drop = _mm256_set1_epi32(-1);
+    for (int j = 0; j < numRanges; j++) {
+      drop = _mm256_and_si256(drop, _mm256_or_si256(_mm256_cmpgt_epi32(lo[j], k),
+                                                    _mm256_cmpgt_epi32(k, hi[j])));
+    }
+    unsigned keep = ~_mm256_movemask_ps(_mm256_castsi256_ps(drop)) & 0xff;
+    __m256i  perm = _mm256_loadu_si256((const __m256i*) keepPositions[keep]);
+    _mm256_storeu_si256((__m256i*) (sel + count), _mm256_permutevar8x32_epi32(pos, perm));
+    count += __builtin_popcount(keep);
+    pos = _mm256_add_epi32(pos, step);
+  }
+
+  return count + selectRangesScalar(keys, i, n, ranges, numRanges, sel + count);
+}
+#endif
+
+Predicate::Predicate(const vector<SelCond>& cond)
+{
+  // sort the conditions into their groups
+  int numGroups = 1;
+  for (unsigned i = 0; i < cond.size(); i++) numGroups = std::max(numGroups, cond[i].group + 1);
+  vector<Group> all(numGroups);
+  for (unsigned i = 0; i < cond.size(); i++) all[cond[i].group].add(cond[i]);
+
+  // keep the groups that can match, and the keys each of them allows:
+  // its range with the excluded keys cut out
+  vector<KeyRange> allowed;
+  keyRange   = true;
+  valueConds = false;
+  for (int g = 0; g < numGroups; g++) {
+    all[g].finish();
+    if (all[g].empty) continue;
+    groups.push_back(all[g]);
+    keyRange   = keyRange && all[g].keyRange;
+    valueConds = valueConds || all[g].valueConds;
+
+    if (all[g].keySet) {
+      // a key IN list allows its keys one by one
+      for (unsigned i = 0; i < all[g].keys.size(); i++) {
+        KeyRange single = {all[g].keys[i], all[g].keys[i]};
+        allowed.push_back(single);
+      }
+      continue;
+    }
+
+    const vector<int>& excluded = all[g].excludedKeys;
+    KeyRange           range    = {all[g].minKey, all[g].maxKey};
+    bool               tail     = true;
+    for (unsigned i = 0; i < excluded.size(); i++) {
+      if (excluded[i] > range.lo) {
+        KeyRange below = {range.lo, excluded[i] - 1};
+        allowed.push_back(below);
+      }
+      if (excluded[i] == range.hi) {
+        tail = false;
+        break;
+      }
+      range.lo = excluded[i] + 1;
+    }
+    if (tail) allowed.push_back(range);
+  }
+
+  // merge the ranges that overlap or touch
+  sort(allowed.begin(), allowed.end(), keyRangeLess);
+  for (unsigned i = 0; i < allowed.size(); i++) {
+    if (!ranges.empty() && (allowed[i].lo <= ranges.back().hi ||
+                            (long long) allowed[i].lo - 1 == ranges.back().hi)) {
+      ranges.back().hi = std::max(ranges.back().hi, allowed[i].hi);
+    } else {
+      ranges.push_back(allowed[i]);
+    }
+  }
+
+  if (ranges.empty()) {
+    // no key is between the bounds
+    keyRange = false;
+    minKey   = std::numeric_limits<int>::max();
+    maxKey   = std::numeric_limits<int>::min();
+  } else {
+    minKey = ranges.front().lo;
+    maxKey = ranges.back().hi;
+  }
+
+  keyEquals = !ranges.empty();
+  holesOnly = true;
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    keyEquals = keyEquals && ranges[i].lo == ranges[i].hi;
+    if (i > 0) {
+      if ((long long) ranges[i].lo - ranges[i - 1].hi == 2) holes.push_back(ranges[i].lo - 1);
+      else holesOnly = false;
+    }
+  }
+  if (!holesOnly) holes.clear();
+}
+
+bool Predicate::overlaps(int lo, int hi) const
+{
+  if (ranges.empty() || hi < minKey || lo > maxKey) return false;
+
+  // the last range starting at or below hi; no range before it reaches
+  // further up
+  int first = 0, last = ranges.size() - 1;
+  while (first < last) {
+    int mid = (first + last + 1) / 2;
+    if (ranges[mid].lo <= hi) first = mid;
+    else last = mid - 1;
+  }
+  return ranges[first].lo <= hi && ranges[first].hi >= lo;
+}
+
+Predicate::Group::Group()
+{
+  empty         = false;
+  keyRange      = false;
+  minKey        = std::numeric_limits<int>::min();
+  maxKey        = std::numeric_limits<int>::max();
+  keySet        = false;
+  valueConds    = false;
+  valueEquals   = false;
+  valueLoExists = false;
+  valueLoStrict = false;
+  valueHiExists = false;
+  valueHiStrict = false;
+}
+
+void Predicate::Group::add(const SelCond& cond)
+{
+  if (cond.attr == 1) {
+    if (cond.comp == SelCond::IN_KEYS) {
+      // the keys of the list, sorted; ANDed lists keep the keys in both
+      vector<int> list;
+      for (const char* s = cond.value; *s != '\0'; s++) {
+        list.push_back(atoi(s));
+        if ((s = strchr(s, ',')) == NULL) break;
+      }
+      sort(list.begin(), list.end());
+      list.erase(unique(list.begin(), list.end()), list.end());
+      if (keySet) {
+        vector<int> both;
+        std::set_intersection(keys.begin(), keys.end(), list.begin(), list.end(),
+                              std::back_inserter(both));
+        list.swap(both);
+      }
+      keys.swap(list);
+      keySet   = true;
+      keyRange = true;
+      return;
+    }
+
+    int key = atoi(cond.value);
+    if (cond.comp == SelCond::NE) {
+      excludedKeys.push_back(key);
+      return;
+    }
+
+    keyRange = true;
+    switch (cond.comp) {
+      case SelCond::EQ:
+        minKey = std::max(minKey, key);
+        maxKey = std::min(maxKey, key);
+        break;
+      case SelCond::GT:
+        // nothing is above the largest int
+        if (key == std::numeric_limits<int>::max()) empty = true;
+        else minKey = std::max(minKey, key + 1);
+        break;
+      case SelCond::GE:
+        minKey = std::max(minKey, key);
+        break;
+      case SelCond::LT:
+        // nothing is below the smallest int
+        if (key == std::numeric_limits<int>::min()) empty = true;
+        else maxKey = std::min(maxKey, key - 1);
+        break;
+      case SelCond::LE:
+        maxKey = std::min(maxKey, key);
+        break;
+      case SelCond::NE:
+      case SelCond::IN_KEYS:
+        break;
+    }
+  } else if (cond.attr == 2) {
+    valueConds = true;
+    switch (cond.comp) {
+      case SelCond::EQ:
+        valueEquals = true;
+        addValueBound(cond.value, true, false);
+        addValueBound(cond.value, false, false);
+        break;
+      case SelCond::NE:
+        excludedValues.push_back(cond.value);
+        break;
+      case SelCond::GT:
+        addValueBound(cond.value, true, true);
+        break;
+      case SelCond::GE:
+        addValueBound(cond.value, true, false);
+        break;
+      case SelCond::LT:
+        addValueBound(cond.value, false, true);
+        break;
+      case SelCond::LE:
+        addValueBound(cond.value, false, false);
+        break;
+      case SelCond::IN_KEYS:
+        // the parser only makes key IN lists one condition
+        break;
+    }
+  }
+}
+
+void Predicate::Group::finish()
+{
+  if (minKey > maxKey) empty = true;
+
+  // only the excluded keys inside the range are left to check
+  vector<int> inRange;
+  for (unsigned i = 0; i < excludedKeys.size(); i++) {
+    if (excludedKeys[i] >= minKey && excludedKeys[i] <= maxKey) inRange.push_back(excludedKeys[i]);
+  }
+  sort(inRange.begin(), inRange.end());
+  inRange.erase(unique(inRange.begin(), inRange.end()), inRange.end());
+  excludedKeys.swap(inRange);
+
+  // the keys of an IN list that the other conditions allow take the
+  // place of the range and the excluded keys
+  if (keySet) {
+    vector<int> allowed;
+    for (unsigned i = 0; i < keys.size(); i++) {
+      if (keys[i] >= minKey && keys[i] <= maxKey &&
+          !std::binary_search(excludedKeys.begin(), excludedKeys.end(), keys[i])) {
+        allowed.push_back(keys[i]);
+      }
+    }
+    keys.swap(allowed);
+    excludedKeys.clear();
+    if (keys.empty()) {
+      empty = true;
+    } else {
+      minKey = keys.front();
+      maxKey = keys.back();
+    }
+  }
+  if (minKey == maxKey && !excludedKeys.empty()) empty = true;
+
+  if (valueLoExists && valueHiExists) {
+    int diff = valueLo.compare(valueHi);
+    if (diff > 0 || (diff == 0 && (valueLoStrict || valueHiStrict))) empty = true;
+  }
+}
+
+// tighten the lower or the upper bound on the value
+void Predicate::Group::addValueBound(const char* value, bool lower, bool strict)
+{
+  bool&   exists   = lower ? valueLoExists : valueHiExists;
+  bool&   isStrict = lower ? valueLoStrict : valueHiStrict;
+  string& bound    = lower ? valueLo : valueHi;
+
+  if (!exists) {
+    exists   = true;
+    isStrict = strict;
+    bound    = value;
+    return;
+  }
+
+  int diff = strcmp(value, bound.c_str());
+  if (diff == 0) {
+    isStrict = isStrict || strict;
+  } else if (lower ? diff > 0 : diff < 0) {
+    isStrict = strict;
+    bound    = value;
+  }
+}
+
+int Predicate::selectKeys(const int* keys, int n, int* sel) const
+{
+#ifdef HAVE_AVX2_KERNEL
+  // the kernels are compiled for AVX2 on their own, so check the CPU once
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+  if (holesOnly) {
+    // one range, with a few single keys cut out of it
+    const int* excluded    = holes.empty() ? NULL : &holes[0];
+    int        numExcluded = holes.size();
+#ifdef HAVE_AVX2_KERNEL
+    if (avx2) return selectKeysAvx2(keys, n, minKey, maxKey, excluded, numExcluded, sel);
+#endif
+    return selectKeysScalar(keys, 0, n, minKey, maxKey, excluded, numExcluded, sel);
+  }
+
+#ifdef HAVE_AVX2_KERNEL
+  if (avx2 && ranges.size() <= (unsigned) MAX_VECTOR_RANGES) {
+    return selectRangesAvx2(keys, n, &ranges[0], ranges.size(), sel);
+  }
+#endif
+  return selectRangesScalar(keys, 0, n, &ranges[0], ranges.size(), sel);
+}
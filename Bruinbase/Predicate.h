@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "SqlEngine.h"
+
+/**
+ * A closed range [lo, hi] of keys.
+ */
+struct KeyRange {
+  int lo;
+  int hi;
+};
+
+/**
+ * The conditions of a WHERE clause, compiled once per query.
+ * The clause is an OR of groups of ANDed conditions. In every group, the
+ * conditions on the key fold into the closed range [minKey, maxKey] and
+ * a sorted list of excluded keys; those on the value fold into a lower
+ * and an upper bound, each inclusive or strict, and a list of excluded
+ * values. The keys the groups allow are then merged into a sorted list
+ * of disjoint key ranges, with the excluded keys cut out of them.
+ * Checking a tuple is a few comparisons against pre-parsed bounds, with
+ * no parsing and no dispatch on the comparator of every condition.
+ */
+class Predicate {
+ public:
+  /**
+   * compile the conditions of a WHERE clause.
+   * @param cond[IN] the conditions; those with the same group are ANDed
+   * together, and the groups are ORed
+   */
+  explicit Predicate(const std::vector<SelCond>& cond);
+
+  /**
+   * check a tuple against the conditions.
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple; only looked at when there
+   * are conditions on the value
+   * @return true if the tuple meets the conditions
+   */
+  bool matches(int key, const std::string& value) const
+  {
+    return matchesKey(key) && (!valueConds || matchesValue(key, value));
+  }
+
+  /**
+   * @return true if the key is in one of the key ranges
+   */
+  bool matchesKey(int key) const
+  {
+    if (key < minKey || key > maxKey) return false;
+    if (holesOnly) {
+      for (unsigned i = 0; i < holes.size(); i++) {
+        if (holes[i] == key) return false;
+      }
+      return true;
+    }
+
+    // the last range starting at or below the key
+    int lo = 0, hi = ranges.size() - 1;
+    while (lo < hi) {
+      int mid = (lo + hi + 1) / 2;
+      if (ranges[mid].lo <= key) lo = mid;
+      else hi = mid - 1;
+    }
+    return key <= ranges[lo].hi;
+  }
+
+  /**
+   * check the value of a tuple whose key is in one of the key ranges.
+   * @return true if the tuple meets all conditions of some group
+   */
+  bool matchesValue(int key, const std::string& value) const
+  {
+    if (groups.size() == 1) return groups[0].matchesValue(value);
+    for (unsigned i = 0; i < groups.size(); i++) {
+      if (groups[i].matchesKey(key) && groups[i].matchesValue(value)) return true;
+    }
+    return false;
+  }
+
+  /**
+   * @return true if some key in [lo, hi] is in one of the key ranges
+   */
+  bool overlaps(int lo, int hi) const;
+
+  /**
+   * find the keys of a batch that are in the key ranges.
+   * the keys are compared eight at a time with AVX2 instructions when
+   * the CPU has them, and one at a time without branches otherwise.
+   * @param keys[IN] the keys to check
+   * @param n[IN] the number of keys
+   * @param sel[OUT] the positions of the matching keys, in order
+   * @return the number of positions written to sel
+   */
+  int selectKeys(const int* keys, int n, int* sel) const;
+
+  /**
+   * @return true if no tuple can meet the conditions
+   */
+  bool isEmpty() const { return ranges.empty(); }
+
+  /**
+   * @return true if a condition other than <> bounds the key in every
+   * group
+   */
+  bool hasKeyRange() const { return keyRange; }
+
+  /**
+   * @return true if some key is outside of the key ranges
+   */
+  bool hasKeyConds() const
+  {
+    return ranges.size() != 1 || minKey != std::numeric_limits<int>::min()
+           || maxKey != std::numeric_limits<int>::max();
+  }
+
+  /**
+   * @return true if every key range is a single key, as with key = N or
+   * key IN (...)
+   */
+  bool hasKeyEquals() const { return keyEquals; }
+
+  /**
+   * @return the smallest and the largest key in the key ranges
+   */
+  int getMinKey() const { return minKey; }
+  int getMaxKey() const { return maxKey; }
+
+  /**
+   * @return the keys the conditions allow, as sorted, disjoint ranges
+   */
+  const std::vector<KeyRange>& getKeyRanges() const { return ranges; }
+
+  /**
+   * @return true if there is a condition on the value
+   */
+  bool hasValueConds() const { return valueConds; }
+
+  /**
+   * the value bounds are those of the only group; with more than one
+   * group, there are none
+   * @return true if a condition requires the value to equal a constant
+   */
+  bool hasValueEquals() const { return groups.size() == 1 && groups[0].valueEquals; }
+
+  bool               hasValueLo() const { return groups.size() == 1 && groups[0].valueLoExists; }
+  bool               hasValueHi() const { return groups.size() == 1 && groups[0].valueHiExists; }
+  const std::string& getValueLo() const { return groups[0].valueLo; }
+  const std::string& getValueHi() const { return groups[0].valueHi; }
+
+ private:
+  // the ANDed conditions of one group
+  struct Group {
+    bool             empty;
+    bool             keyRange;
+    int              minKey;
+    int              maxKey;
+    std::vector<int> excludedKeys;  // the keys in [minKey, maxKey] excluded by <>, sorted
+    bool             keySet;        // true if key IN (...) lists the allowed keys
+    std::vector<int> keys;          // those keys, sorted, after finish() only the
+                                    // ones in [minKey, maxKey] and not excluded
+
+    bool                     valueConds;
+    bool                     valueEquals;
+    bool                     valueLoExists;
+    bool                     valueLoStrict;
+    std::string              valueLo;
+    bool                     valueHiExists;
+    bool                     valueHiStrict;
+    std::string              valueHi;
+    std::vector<std::string> excludedValues;
+
+    Group();
+    void add(const SelCond& cond);
+    void finish();
+    void addValueBound(const char* value, bool lower, bool strict);
+
+    bool matchesKey(int key) const
+    {
+      if (key < minKey || key > maxKey) return false;
+      if (keySet) return std::binary_search(keys.begin(), keys.end(), key);
+      for (unsigned i = 0; i < excludedKeys.size(); i++) {
+        if (excludedKeys[i] == key) return false;
+      }
+      return true;
+    }
+
+    bool matchesValue(const std::string& value) const
+    {
+      const char* v = value.c_str();
+      int         diff;
+      if (valueLoExists) {
+        diff = strcmp(v, valueLo.c_str());
+        if (diff < 0 || (diff == 0 && valueLoStrict)) return false;
+      }
+      if (valueHiExists) {
+        diff = strcmp(v, valueHi.c_str());
+        if (diff > 0 || (diff == 0 && valueHiStrict)) return false;
+      }
+      for (unsigned i = 0; i < excludedValues.size(); i++) {
+        if (strcmp(v, excludedValues[i].c_str()) == 0) return false;
+      }
+      return true;
+    }
+  };
+
+  std::vector<Group>    groups;     // the groups that can match
+  std::vector<KeyRange> ranges;     // the keys they allow
+  bool                  keyRange;
+  bool                  keyEquals;
+  bool                  valueConds;
+  int                   minKey;
+  int                   maxKey;
+
+  // when the gaps between the ranges are all single keys, the ranges are
+  // [minKey, maxKey] without the keys in holes
+  bool             holesOnly;
+  std::vector<int> holes;
+};
+
+#endif // PREDICATE_H
@@ -7,6 +7,7 @@
  * @date 3/24/2008
  */
 
+#include <limits>
 #include "Bruinbase.h"
 #include "RecordFile.h"
 
@@ -31,6 +32,15 @@ static int getRecordCount(const char* page);
 // update # records stored in the page
 static void setRecordCount(char* page, int count);
 
+// read the key range of the n'th entry in a zone map page
+static void readZone(const char* page, int n, int& minKey, int& maxKey);
+
+// write the key range of the n'th entry in a zone map page
+static void writeZone(char* page, int n, int minKey, int maxKey);
+
+// compute the name of the zone map file of a record file
+static string zoneMapName(const string& filename);
+
 
 //
 // helper functions for RecordId manipulation
@@ -106,13 +116,31 @@ RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  hasZoneMap = false;
+  zoneCount = 0;
+  zonePid = -1;
+  zoneDirty = false;
+  tailPid = -1;
+  tailDirty = false;
 }
 
 RecordFile::RecordFile(const string& filename, char mode)
 {
+  hasZoneMap = false;
+  tailPid = -1;
+  tailDirty = false;
+  zoneCount = 0;
+  zonePid = -1;
+  zoneDirty = false;
   open(filename, mode);
 }
 
+RecordFile::~RecordFile()
+{
+  flushTailPage();
+  if (hasZoneMap) flushZonePage();
+}
+
 RC RecordFile::open(const string& filename, char mode)
 {
   RC   rc;
@@ -132,7 +160,7 @@ RC RecordFile::open(const string& filename, char mode)
   // set the end record id to (0, 0).
   if (erid.pid == 0) {
     erid.sid = 0;
-    return 0;
+    return openZoneMap(filename, mode);
   }
 
   // obtain # records in the last page to set sid of the end record id.
@@ -153,15 +181,132 @@ RC RecordFile::open(const string& filename, char mode)
     erid.sid = 0;
   }
   
+  return openZoneMap(filename, mode);
+}
+
+RC RecordFile::openZoneMap(const string& filename, char mode)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  hasZoneMap = false;
+  zoneCount = 0;
+  zonePid = -1;
+  zoneDirty = false;
+
+  // a table without a zone map is still readable; it just cannot be pruned
+  if (zf.open(zoneMapName(filename), mode) < 0) {
+    return (mode == 'r' || mode == 'R') ? 0 : RC_FILE_OPEN_FAILED;
+  }
+  hasZoneMap = true;
+
+  // in read mode, the number of covered pages is looked up the first time
+  // getKeyRange() is called, so queries that never prune do not pay for it
+  if (mode == 'r' || mode == 'R') {
+    zoneCount = -1;
+    return 0;
+  }
+
+  if ((rc = countZones()) < 0) return rc;
+
+  // the table may have been written before it had a zone map.
+  // compute the ranges of the pages that are not covered yet.
+  PageId epid = (erid.sid > 0) ? erid.pid + 1 : erid.pid;
+  for (PageId pid = zoneCount; pid < epid; pid++) {
+    int minKey = 0, maxKey = 0, key;
+    string value;
+
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    int count = getRecordCount(page);
+    for (int i = 0; i < count; i++) {
+      readSlot(page, i, key, value);
+      if (i == 0 || key < minKey) minKey = key;
+      if (i == 0 || key > maxKey) maxKey = key;
+    }
+
+    if ((rc = loadZonePage(pid / ZONES_PER_PAGE)) < 0) return rc;
+    writeZone(zonePage, pid % ZONES_PER_PAGE, minKey, maxKey);
+    setRecordCount(zonePage, pid % ZONES_PER_PAGE + 1);
+    zoneDirty = true;
+    zoneCount = pid + 1;
+  }
+
+  return flushZonePage();
+}
+
+RC RecordFile::countZones() const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  // the number of covered pages is given by the count in the last zone page
+  zoneCount = 0;
+  if (zf.endPid() > 0) {
+    if ((rc = zf.read(zf.endPid() - 1, page)) < 0) return rc;
+    zoneCount = (zf.endPid() - 1) * ZONES_PER_PAGE + getRecordCount(page);
+  }
+
+  return 0;
+}
+
+RC RecordFile::loadZonePage(PageId zpid)
+{
+  RC rc;
+
+  if (zonePid == zpid) return 0;
+  if ((rc = flushZonePage()) < 0) return rc;
+
+  if (zpid < zf.endPid()) {
+    if ((rc = zf.read(zpid, zonePage)) < 0) return rc;
+  } else {
+    memset(zonePage, 0, PageFile::PAGE_SIZE);
+  }
+  zonePid = zpid;
+
+  return 0;
+}
+
+RC RecordFile::flushZonePage()
+{
+  RC rc;
+
+  if (!zoneDirty) return 0;
+  if ((rc = zf.write(zonePid, zonePage)) < 0) return rc;
+  zoneDirty = false;
+
+  return 0;
+}
+
+RC RecordFile::flushTailPage()
+{
+  RC rc;
+
+  if (!tailDirty) return 0;
+  if ((rc = pf.write(tailPid, tailPage)) < 0) return rc;
+  tailDirty = false;
+
   return 0;
 }
 
 RC RecordFile::close()
 {
+  RC rc = flushTailPage();
+
   erid.pid = 0;
   erid.sid = 0;
+  tailPid = -1;
+  tailDirty = false;
+
+  if (hasZoneMap) {
+    RC zoneRc = flushZonePage();
+    if (rc == 0) rc = zoneRc;
+    zf.close();
+    hasZoneMap = false;
+    zonePid = -1;
+  }
 
-  return pf.close();
+  RC closeRc = pf.close();
+  return (rc < 0) ? rc : closeRc;
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
@@ -174,6 +319,12 @@ RC RecordFile::read(const RecordId& rid, int& key, string& value) const
   if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
+  // the last page may not have been written out yet
+  if (rid.pid == tailPid && tailDirty) {
+    readSlot(tailPage, rid.sid, key, value);
+    return 0;
+  }
+
   // read the page containing the record
   if ((rc = pf.read(rid.pid, page)) < 0) return rc;
 
@@ -183,30 +334,82 @@ RC RecordFile::read(const RecordId& rid, int& key, string& value) const
   return 0;
 }
 
-RC RecordFile::append(int key, const std::string& value, RecordId& rid)
+RC RecordFile::readPage(PageId pid, int keys[], string values[], int& count) const
 {
   RC   rc;
   char page[PageFile::PAGE_SIZE];
 
+  // check whether the pid is in the valid range
+  if (pid < 0 || pid > erid.pid) return RC_INVALID_PID;
+  if (pid == erid.pid && erid.sid == 0) {
+    // the page after the last full page has not been written yet
+    count = 0;
+    return 0;
+  }
+
+  // read the page once for all of its records. the last page may not
+  // have been written out yet.
+  if (pid == tailPid && tailDirty) {
+    memcpy(page, tailPage, PageFile::PAGE_SIZE);
+  } else if ((rc = pf.read(pid, page)) < 0) {
+    return rc;
+  }
+
+  count = getRecordCount(page);
+  for (int i = 0; i < count; i++) {
+    if (values != NULL) {
+      readSlot(page, i, keys[i], values[i]);
+    } else {
+      memcpy(&keys[i], slotPtr(page, i), sizeof(int));
+    }
+  }
+
+  return 0;
+}
+
+RC RecordFile::append(int key, const std::string& value, RecordId& rid)
+{
+  RC   rc;
+
   // unless we are writing to the the first slot of an empty page,
-  // we have to read the page first
-  if (erid.sid > 0) {
-    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
-  } else {
-    // if this is the first slot of an empty page
-    // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+  // we have to read the page first, unless it is already in memory
+  if (tailPid != erid.pid) {
+    if ((rc = flushTailPage()) < 0) return rc;
+    if (erid.sid > 0) {
+      if ((rc = pf.read(erid.pid, tailPage)) < 0) return rc;
+    } else {
+      // if this is the first slot of an empty page
+      // we can simply initialize the page with zeros
+      memset(tailPage, 0, PageFile::PAGE_SIZE);
+    }
+    tailPid = erid.pid;
   }
     
   // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
+  writeSlot(tailPage, erid.sid, key, value);
 
   // the first four bytes in the page stores # records in the page.
   // update this number.
-  setRecordCount(page, erid.sid + 1);
-
-  // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
+  setRecordCount(tailPage, erid.sid + 1);
+  tailDirty = true;
+
+  // write the page to the disk once it is full
+  if (erid.sid + 1 == RECORDS_PER_PAGE && (rc = flushTailPage()) < 0) return rc;
+
+  // widen the key range of the page in the zone map
+  if (hasZoneMap) {
+    int minKey = key, maxKey = key;
+    if ((rc = loadZonePage(erid.pid / ZONES_PER_PAGE)) < 0) return rc;
+    if (erid.sid > 0) {
+      readZone(zonePage, erid.pid % ZONES_PER_PAGE, minKey, maxKey);
+      if (key < minKey) minKey = key;
+      if (key > maxKey) maxKey = key;
+    }
+    writeZone(zonePage, erid.pid % ZONES_PER_PAGE, minKey, maxKey);
+    setRecordCount(zonePage, erid.pid % ZONES_PER_PAGE + 1);
+    zoneDirty = true;
+    zoneCount = erid.pid + 1;
+  }
     
   // we need to output the rid of the record slot
   rid = erid;
@@ -222,6 +425,34 @@ const RecordId& RecordFile::endRid() const
   return erid;
 }
 
+RC RecordFile::getKeyRange(PageId pid, int& minKey, int& maxKey) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  if (pid < 0 || pid > erid.pid) return RC_INVALID_PID;
+
+  if (hasZoneMap && zoneCount < 0) {
+    if ((rc = countZones()) < 0) return rc;
+  }
+
+  // without a zone map entry, any key may be in the page
+  if (!hasZoneMap || pid >= zoneCount) {
+    minKey = std::numeric_limits<int>::min();
+    maxKey = std::numeric_limits<int>::max();
+    return 0;
+  }
+
+  if (pid / ZONES_PER_PAGE == zonePid) {
+    readZone(zonePage, pid % ZONES_PER_PAGE, minKey, maxKey);
+  } else {
+    if ((rc = zf.read(pid / ZONES_PER_PAGE, page)) < 0) return rc;
+    readZone(page, pid % ZONES_PER_PAGE, minKey, maxKey);
+  }
+
+  return 0;
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
@@ -275,3 +506,26 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
     strcpy(ptr + sizeof(int), value.c_str());
   }
 }
+
+static void readZone(const char* page, int n, int& minKey, int& maxKey)
+{
+  // each zone map entry is a pair of integers following the entry count
+  const char *ptr = page + sizeof(int) + 2 * sizeof(int) * n;
+  memcpy(&minKey, ptr, sizeof(int));
+  memcpy(&maxKey, ptr + sizeof(int), sizeof(int));
+}
+
+static void writeZone(char* page, int n, int minKey, int maxKey)
+{
+  char *ptr = page + sizeof(int) + 2 * sizeof(int) * n;
+  memcpy(ptr, &minKey, sizeof(int));
+  memcpy(ptr + sizeof(int), &maxKey, sizeof(int));
+}
+
+static string zoneMapName(const string& filename)
+{
+  // "movie.tbl" has its zone map in "movie.zmp"
+  string::size_type dot = filename.rfind('.');
+  if (dot == string::npos) return filename + ".zmp";
+  return filename.substr(0, dot) + ".zmp";
+}
@@ -54,6 +54,12 @@ class RecordFile {
 
   RecordFile();
   RecordFile(const std::string& filename, char mode);
+
+  /**
+   * write out the records appended to the last page and their key range
+   * in the zone map, even if the file was not closed.
+   */
+  ~RecordFile();
   
   /**
    * open a file in read or write mode.
@@ -79,6 +85,17 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read all records in a page at once.
+   * @param pid[IN] the page to read
+   * @param keys[OUT] the record keys; room for RECORDS_PER_PAGE keys
+   * @param values[OUT] the record values; room for RECORDS_PER_PAGE
+   * values, or NULL if only the keys are needed
+   * @param count[OUT] the number of records in the page
+   * @return error code. 0 if no error
+   */
+  RC readPage(PageId pid, int keys[], std::string values[], int& count) const;
+
   /**
    * append a new record at the end of the file.
    * note that RecordFile does not have write() function.
@@ -96,9 +113,47 @@ class RecordFile {
    */
   const RecordId& endRid() const;
 
+  /**
+   * get the smallest and the largest key stored in a page.
+   * the ranges come from the zone map, a side file that append() keeps
+   * up to date, so the page itself is not read. if no zone map is
+   * available for the page, the whole int range is returned.
+   * @param pid[IN] the page to look up
+   * @param minKey[OUT] no key in the page is smaller than this
+   * @param maxKey[OUT] no key in the page is larger than this
+   * @return error code. 0 if no error
+   */
+  RC getKeyRange(PageId pid, int& minKey, int& maxKey) const;
+
+  // number of (min key, max key) entries per zone map page
+  static const int ZONES_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int)) / (2 * sizeof(int));
+    // the first four bytes in a zone map page store # entries in the page.
+
  private:
+  RC openZoneMap(const std::string& filename, char mode);
+  RC countZones() const;
+  RC loadZonePage(PageId zpid);
+  RC flushZonePage();
+  RC flushTailPage();
+
   PageFile pf;     // the PageFile used to store the records
   RecordId erid;   // the last record id of the file + 1
+
+  PageFile zf;     // the PageFile used to store the zone map
+  bool     hasZoneMap;  // true if the zone map could be opened
+  mutable int zoneCount;   // # pages covered by the zone map (-1: not known yet)
+
+  // the zone map page being updated by append(). it is written out when
+  // append() moves on to the next zone map page and when the file is closed.
+  PageId   zonePid;
+  bool     zoneDirty;
+  char     zonePage[PageFile::PAGE_SIZE];
+
+  // the last page, being filled by append(). it is written out once it is
+  // full and when the file is closed, instead of after every record.
+  PageId   tailPid;
+  bool     tailDirty;
+  char     tailPage[PageFile::PAGE_SIZE];
 };
 
 #endif // RECORDFILE_H
@@ -9,12 +9,22 @@
 
 #include <cstdio>
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <limits> // for std::numeric_limits
+#include <algorithm>
+#include <cmath>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include "BTreeIndex.h"
+#include "BloomFilter.h"
+#include "ArtIndex.h"
+#include "HashIndex.h"
+#include "ValueIndex.h"
+#include "ClusteredIndex.h"
+#include "Operator.h"
+#include "Join.h"
+#include "Predicate.h"
+#include "LoadFile.h"
 #include <sys/stat.h>
 
 using namespace std;
@@ -23,6 +33,9 @@ using namespace std;
 extern FILE* sqlin;
 int sqlparse(void);
 
+map<string, ArtIndex*> SqlEngine::residentIndexes;
+map<string, TableCatalog> SqlEngine::catalogs;
+
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -41,124 +54,228 @@ inline bool fileExists(const std::string& name) {
   return (stat (name.c_str(), &buffer) == 0);
 }
 
-RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
+// Open the B+tree index of a table for reading, if it has one. An index
+// file in an older layout cannot be read, so the table is used as if it
+// had no index until CREATE INDEX rebuilds it.
+static RC openKeyIndex(const string& table, BTreeIndex& index, bool& opened)
 {
-  RecordFile rf;   // RecordFile containing the table
-  RecordId   rid;  // record cursor for table scanning
-
-  RC     rc;
-  int    key;
-  string value;
-  int    diff;
+  opened = false;
+  if (!fileExists(table + ".idx")) return 0;
 
-  // open the table file
-  if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
-    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
-    return rc;
+  RC rc = index.open(table + ".idx", 'r');
+  if (rc == RC_INVALID_FILE_FORMAT) {
+    fprintf(stderr, "Warning: the index of table %s has an old layout and is not used;"
+            " rebuild it with CREATE INDEX ON %s(key)\n", table.c_str(), table.c_str());
+    return 0;
   }
+  if (rc != 0) return rc;
+  opened = true;
+  return 0;
+}
 
-  // Check if index exists
-  // Open index if so
-  // Set validIndex if it worked
-  BTreeIndex index;
-  bool validIndex;
-  if (fileExists(table+".idx")){
-    RC result = index.open(table+".idx", 'r');
-    if(result != 0) return result;
-    validIndex = true;
-  } else {
-    validIndex = false;
+// Open the clustered index a table is stored in for reading. A table
+// stored in an older layout has to be loaded again.
+static RC openClusteredIndex(const string& table, ClusteredIndex& index)
+{
+  RC rc = index.open(table + ".iot", 'r');
+  if (rc == RC_INVALID_FILE_FORMAT) {
+    fprintf(stderr, "Error: table %s is stored in an old layout;"
+            " remove %s.iot and load the table again\n", table.c_str(), table.c_str());
   }
+  return rc;
+}
 
-  bool useIndex     = false;
-
-  bool noResults    = false;
+inline bool indexEntryLess(const IndexEntry& a, const IndexEntry& b) {
+  return a.key < b.key;
+}
 
-  bool equalsExists = false;
-  int  equalsKey    = -1;
-  bool gtExists     = false;
-  bool gtNotGte     = false; // Greater-than, not Greater-than-or-equal
-  int  gtKey        = std::numeric_limits<int>::min();
-  bool ltExists     = false;
-  bool ltNotLte     = false; // Less-than, not Less-than-or-equal
-  int  ltKey        = std::numeric_limits<int>::max();
+// The index stage of a load: sort the (key, rid) pairs of the table and
+// bulk-load the B+tree over them, replacing the old index. It runs on a
+// thread of its own while the load writes the other files.
+// The entries from firstNew on are the rows the load appended. When they
+// are few next to an existing B+tree, inserting them one at a time
+// touches fewer pages than rewriting the tree, so they go into it.
+// A load without a WITH clause keeps the kind of the existing index, so
+// a learned index is rebuilt with its model.
+class IndexBuild : public MorselTask {
+ public:
+  IndexBuild(const string& table, vector<IndexEntry>& entries, size_t firstNew,
+             SqlEngine::IndexType kind)
+    : table(table), entries(entries), firstNew(firstNew),
+      learned(kind == SqlEngine::LEARNED_INDEX), keepKind(kind == SqlEngine::NO_INDEX), rc(0) {}
 
-  bool needValue    = attr == 2 || attr == 3;
+  void run(int)
+  {
+    BTreeIndex index;
+    BTreeIndex current;
 
-  for (unsigned i = 0; i < cond.size(); i++) {
-    if(cond[i].attr == 1) {
-      int currentKey = atoi(cond[i].value);
-      if(cond[i].comp == SelCond::NE) {
-        if(equalsExists && equalsKey == currentKey) {
-            noResults = true;
+    if(!learned && current.open(table + ".idx", 'r') == 0) {
+      if(keepKind) learned = current.isLearned();
+      // every insert reads and writes a node on each level
+      bool incremental = !current.isLearned() && firstNew > 0
+        && current.getEntryCount() == (int) firstNew
+        && (double) (entries.size() - firstNew) * 2 * current.getTreeHeight() < current.getPageCount();
+      current.close();
+      if(incremental) {
+        if((rc = index.open(table + ".idx", 'w')) < 0) return;
+        for(size_t i = firstNew; i < entries.size() && rc == 0; i++) {
+          rc = index.insert(entries[i].key, entries[i].rid);
         }
-      } else {
-        useIndex = true;
-        switch(cond[i].comp) {
-          case SelCond::EQ:
-            if(equalsExists) {
-              if(equalsKey != currentKey) {
-                noResults = true;
-              }
-            } else {
-              equalsExists = true;
-              equalsKey = currentKey;
-            }
-            break;
-          case SelCond::GT:
-            if(!gtExists || currentKey >= gtKey) {
-              // If the original was a GT, then we can set it because we will
-              // either smallen the range or keep it the same. If the original
-              // was a GE, then we will only smallen the range (and will leave
-              // it alone if it is the same.)
-              gtExists = true;
-              gtKey = currentKey;
-              gtNotGte = true;
-            }
-            break;
-          case SelCond::LT:
-            if(!ltExists || currentKey <= ltKey) {
-              // If the original was a LT, then we can set it because we will
-              // either smallen the range or keep it the same. If the original
-              // was a LE, then we will only smallen the range (and will leave
-              // it alone if it is the same.)
-              ltExists = true;
-              ltKey = currentKey;
-              ltNotLte = true;
-            }
-            break;
-          case SelCond::GE:
-            if(!gtExists || currentKey > gtKey) {
-              // Here, we check if currentKey > gtKey. If it was a GT,
-              // then we should change it only if it was greater than the
-              // original limit. In this case, it may or may not smallen
-              // the range, but it will surely not increase it. If it was
-              // originally a GE, then again we need to change it only when
-              // the value will be different.
-              gtExists = true;
-              gtKey = currentKey;
-              gtNotGte = false;
-            }
-            break;
-          case SelCond::LE:
-            if(!ltExists || currentKey < ltKey) {
-              ltExists = true;
-              ltKey = currentKey;
-              ltNotLte = true;
-            }
-            break;
+        if(rc != 0) {
+          index.close();
+          return;
         }
+        rc = index.close();
+        return;
       }
-    } else if(cond[i].attr == 2) {
-      // There is a condition on the value, which means we will
-      // need to read the value for every iteration in the index
-      needValue = true;
     }
 
-    if(noResults) break;
+    sort(entries.begin(), entries.end(), indexEntryLess);
+    remove((table + ".idx").c_str());
+    if((rc = index.open(table + ".idx", 'w')) < 0) return;
+    rc = learned ? index.bulkLoadLearned(entries) : index.bulkLoad(entries);
+    if(rc != 0) {
+      index.close();
+      return;
+    }
+    rc = index.close();
   }
-  
-  if(attr == 4 && !needValue) {
+
+  const string&       table;
+  vector<IndexEntry>& entries;
+  size_t              firstNew;
+  bool                learned;
+  bool                keepKind;
+  RC                  rc;
+};
+
+// the cost model counts page reads, like runSelect() reports them, plus
+// a small charge for checking every tuple
+static const double TUPLE_CPU_COST = 0.01;
+
+// the expected number of distinct pages hit by fetching rows records
+// spread evenly over pages pages (Cardenas' formula)
+static double pagesTouched(double pages, double rows)
+{
+  if (pages <= 0) return 0;
+  return pages * (1 - pow(1 - 1 / pages, rows));
+}
+
+// the estimated cost of reading rows entries through an index: the descent
+// to the first leaf, the leaves in range and, when the values are needed,
+// the fetches from the table. tree is NULL for a memory-resident index.
+static double estimateIndexCost(const TableCatalog& catalog, const BTreeIndex* tree,
+                                double rows, bool needValue, bool sortedFetch)
+{
+  double cost = rows * TUPLE_CPU_COST;
+
+  if (tree != NULL && tree->getEntryCount() > 0) {
+    // nearly all pages but the meta page are leaves
+    double leafPages = std::max(1, tree->getPageCount() - 1);
+    double leaves    = ceil(leafPages * rows / tree->getEntryCount());
+    cost += tree->getTreeHeight() - 1 + std::max(1.0, leaves);
+  }
+
+  if (needValue) {
+    // the sorted fetch reads every page once; otherwise every row costs a read
+    cost += sortedFetch ? pagesTouched(catalog.getPageCount(), rows) : rows;
+  }
+  return cost;
+}
+
+// the estimated cost of reading the whole table in page order
+static double estimateScanCost(const TableCatalog& catalog)
+{
+  return catalog.getPageCount() + catalog.getRowCount() * TUPLE_CPU_COST;
+}
+
+RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond,
+                     const SelOrder& order, bool explain)
+{
+  RecordFile rf;   // RecordFile containing the table
+  RC         rc;
+
+  // The groups of a GROUP BY value are ordered by their value or their
+  // count, and only they have a count to order by
+  bool grouped = attr == 11 || attr == 12;
+  if (grouped ? order.attr == 1 : order.attr == 4) {
+    fprintf(stderr, "Error: %s\n", grouped ? "the groups are ordered by value or COUNT(*)"
+                                           : "ORDER BY COUNT(*) needs GROUP BY value");
+    return RC_INVALID_ATTRIBUTE;
+  }
+
+  // LIMIT 0 asks for no rows, whatever the table holds
+  if (order.limit == 0) {
+    if (explain) fprintf(stdout, "access path: none, LIMIT 0\n");
+    return 0;
+  }
+
+  // a clustered table is stored in its index
+  bool clustered = fileExists(table + ".iot");
+
+  // The catalog keeps the row count and the key range of a table, so an
+  // unfiltered count, minimum or maximum of the key needs nothing else
+  const TableCatalog* catalog = NULL;
+  if (!clustered && cond.empty() && attr >= 4 && attr <= 6) catalog = getCatalog(table);
+  if (attr == 4 && cond.empty() && catalog != NULL) {
+    if (explain) {
+      fprintf(stdout, "access path: catalog row count\n");
+    } else {
+      fprintf(stdout, "%d\n", catalog->getRowCount());
+    }
+    return 0;
+  }
+  if ((attr == 5 || attr == 6) && cond.empty() && catalog != NULL) {
+    if (explain) {
+      fprintf(stdout, "access path: catalog key range\n");
+    } else if (catalog->getRowCount() == 0) {
+      fprintf(stdout, "NULL\n");
+    } else {
+      fprintf(stdout, "%d\n", attr == 5 ? catalog->getMinKey() : catalog->getMaxKey());
+    }
+    return 0;
+  }
+
+  // open the table file, unless the table is stored in its index
+  if (!clustered && (rc = rf.open(table + ".tbl", 'r')) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return rc;
+  }
+
+  BTreeIndex     index;
+  HashIndex      hashIndex;
+  ValueIndex     valueIndex;
+  ClusteredIndex clusteredIndex;
+  bool validIndex;
+  bool useHash       = false;
+  bool useValueIndex = false;
+
+  // Compile the WHERE clause once. The key conditions fold into sorted,
+  // disjoint key ranges within [minKey, maxKey]: the index scan jumps
+  // from one range to the next, and the table scan uses them to skip
+  // pages whose zone map range falls outside of all of them.
+  Predicate pred(cond);
+  const vector<KeyRange>& ranges = pred.getKeyRanges();
+  bool noResults    = pred.isEmpty();
+  bool equalsExists = pred.hasKeyEquals();
+  bool singleKey    = equalsExists && ranges.size() == 1;
+  int  minKey       = pred.getMinKey();
+  int  maxKey       = pred.getMaxKey();
+  bool useIndex     = pred.hasKeyRange();
+
+  // A condition on the value means we will need to read the value for
+  // every tuple found in the index
+  bool needValue    = attr == 2 || attr == 3 || attr == 9 || attr == 10 || grouped
+                      || pred.hasValueConds() || (order.attr == 2 && attr <= 3);
+
+  // A count or an aggregate of the key that needs no value is answered
+  // from the index alone: the count from its entry counts, the minimum
+  // and the maximum from the first and the last entry of the range, and
+  // the sum and the average from its leaves
+  bool keyAggregate = !needValue && attr >= 4 && attr <= 8;
+  bool keyBound     = !needValue && (attr == 5 || attr == 6);
+
+  if(keyAggregate) {
     // If we have a count operation and DON'T need the value,
     // then use the index for sure. Otherwise, let the prior
     // code decide whether or not we should use the index
@@ -166,275 +283,1099 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     useIndex = true;
   }
 
-  // Now we have gotten our expected ranges. We can rule out some work
-  // if we compare the ends of the ranges.
-  if(!noResults) {
-    // Only do this if we have some results available
-    if(gtExists) {
-      if(    gtKey > ltKey // Such as x >= 5, x <= 4
-         || ((gtNotGte || ltNotLte) && gtKey == ltKey) // Such as x >= 5, x < 5
-         || ((gtNotGte && ltNotLte) && ltKey-gtKey == 1) // Such as x > 4, x < 5
-         || (gtNotGte && gtKey == std::numeric_limits<int>::max())) { // x > 2147483647
-        noResults = true;
-      }
-    }
+  // Rows ordered by the key can come straight out of the index in key
+  // order, and with a LIMIT the index scan stops after the rows asked
+  // for. Every other ordering is sorted after the scan.
+  bool keyOrder = order.attr == 1 && attr <= 3;
+  bool limited  = order.limit >= 0 && attr <= 3;
+  if(keyOrder) useIndex = true;
+
+  // A limited index scan fetches the rows one at a time as they are
+  // asked for, instead of the whole range in page order. When every
+  // entry in the key range is a result and the rows are not sorted
+  // afterwards, it reads no more entries than the limit.
+  bool sortedFetch = needValue && !singleKey && !limited;
+  int  indexLimit  = limited && (order.attr == 0 || keyOrder) && !pred.hasValueConds()
+                     ? order.limit : -1;
+
+  // The value index is used when the key conditions cannot already pick
+  // out a single key, and either the value must equal a string or there
+  // is no key range.
+  bool valueEquals = pred.hasValueEquals();
+  bool valueBound  = pred.hasValueLo() || pred.hasValueHi();
+
+  // Check if index exists
+  // Open index if so
+  // Set validIndex if it worked
+  // A pinned table is looked up in its memory-resident index instead,
+  // and an equality condition on the key in its hash index if it has one
+  ArtIndex* resident = NULL;
+  map<string, ArtIndex*>::iterator pinned = residentIndexes.find(table);
+  if (pinned != residentIndexes.end()) {
+    resident = pinned->second;
+  }
+
+  if (clustered) {
+    RC result = openClusteredIndex(table, clusteredIndex);
+    if(result != 0) return result;
+    validIndex = false;
+  } else if (!noResults && !equalsExists && (valueEquals || !useIndex)
+      && valueBound && fileExists(table+".vdx")) {
+    RC result = valueIndex.open(table+".vdx", 'r');
+    if(result != 0) return result;
+    validIndex    = false;
+    useValueIndex = true;
+  } else if (resident != NULL) {
+    validIndex = true;
+  } else if (equalsExists && !noResults && fileExists(table+".hsh")) {
+    RC result = hashIndex.open(table+".hsh", 'r');
+    if(result != 0) return result;
+    validIndex = true;
+    useHash    = true;
+  } else {
+    RC result = openKeyIndex(table, index, validIndex);
+    if(result != 0) return result;
+  }
 
-    if(ltExists) {
-      if(ltNotLte && ltKey == std::numeric_limits<int>::min()) { // x < -2147483648
-        noResults = true;
+  // Equality conditions on keys that the bloom filter has never seen
+  // cannot match anything, so we can skip both the index and the table.
+  // A memory-resident or hash index answers as fast as the filter, and
+  // so does a B+tree of at most two levels: probing the filter costs a
+  // page on every lookup that finds its key to save one on a miss.
+  bool shallowIndex = validIndex && resident == NULL && !useHash && index.getTreeHeight() <= 2;
+  if(!noResults && equalsExists && resident == NULL && !useHash && !shallowIndex
+     && fileExists(table+".blm")) {
+    BloomFilter filter;
+    bool        mayContain = true;
+    if(filter.open(table+".blm", 'r') == 0) {
+      noResults = true;
+      for(unsigned i = 0; i < ranges.size() && noResults; i++) {
+        if(filter.mayContain(ranges[i].lo, mayContain) != 0 || mayContain) noResults = false;
       }
+      filter.close();
     }
   }
 
   int count = 0;
+  if(noResults && explain) {
+    fprintf(stdout, "access path: none, the conditions cannot match\n");
+    rc = 0;
+    goto exit_select;
+  }
   if(!noResults) {
-    if(validIndex && useIndex) {
-      int minKey;
-      int maxKey;
-      if(equalsExists) {
-        minKey = equalsKey;
-        maxKey = equalsKey;
+    // Weigh the index against a table scan with the statistics in the
+    // catalog. Over a wide key range the index fetches most pages of the
+    // table anyway, out of order, and the scan is cheaper.
+    // A single key found through an index costs a few pages, less than
+    // any scan, so it is not weighed and does not read the catalog.
+    bool   costed    = false;
+    double estRows   = 0;
+    double indexCost = 0;
+    double scanCost  = 0;
+    if(validIndex && useIndex && !useHash && !keyAggregate && !singleKey) {
+      catalog = getCatalog(table);
+    }
+    if(catalog != NULL && validIndex && useIndex && !useHash && !keyAggregate && !singleKey) {
+      costed    = true;
+      for(unsigned i = 0; i < ranges.size(); i++) {
+        estRows += catalog->estimateRange(ranges[i].lo, ranges[i].hi);
+      }
+      indexCost = estimateIndexCost(*catalog, resident == NULL ? &index : NULL,
+                                    indexLimit < 0 ? estRows : std::min<double>(estRows, indexLimit),
+                                    needValue, sortedFetch);
+      scanCost  = estimateScanCost(*catalog);
+      if(scanCost < indexCost) useIndex = false;
+    }
+
+    // A table scan over more than a couple of morsels is split among
+    // one worker thread per processor
+    int  numWorkers = WorkerPool::processorCount();
+    bool parallel   = !clustered && !useValueIndex && !(validIndex && useIndex) && numWorkers > 1
+                      && rf.endRid().pid >= 2 * ParallelScan::MORSEL_PAGES;
+
+    // The rows need sorting unless they come out of the access path in
+    // the order asked for: from the index in key order (descending by
+    // stepping back through it), from a clustered table or the hash index
+    // in ascending key order, or from the hash index as a single row
+    bool indexOrder = keyOrder && validIndex && useIndex && !useHash;
+    bool hashLookup = validIndex && useIndex && useHash;
+    bool needSort   = order.attr != 0 && attr <= 3 && !indexOrder && !(hashLookup && singleKey)
+                      && !((clustered || hashLookup) && keyOrder && !order.desc);
+
+    if(explain) {
+      string path;
+      if(clustered) {
+        path = "clustered index range scan";
+      } else if(useValueIndex) {
+        path = "value index range scan";
+      } else if(validIndex && useIndex) {
+        if(useHash) {
+          path = "hash index lookup";
+        } else if(attr == 4 && !needValue && resident == NULL) {
+          path = "B+tree entry counts";
+        } else if(keyBound) {
+          path = resident != NULL ? "memory-resident index" : "B+tree";
+          path += attr == 5 ? " first entry of the range" : " last entry of the range";
+        } else {
+          path = resident != NULL ? "memory-resident index range scan" : "B+tree index range scan";
+          if(sortedFetch) path += " with sorted record fetch";
+        }
+      } else if(pred.hasKeyRange()) {
+        path = "table scan with zone map pruning";
       } else {
-        if(gtExists) {
-          if(gtNotGte) {
-            // We should convert the GT into a GTE by adding one.
-            // We have already confirmed that the gtKey is not int_max
-            minKey = gtKey + 1;
-          } else {
-            minKey = gtKey;
-          }
+        path = "table scan";
+      }
+      if(parallel) {
+        char workers[32];
+        sprintf(workers, " on %d threads", numWorkers);
+        path = "parallel " + path + workers;
+      }
+      if(ranges.size() > 1) {
+        fprintf(stdout, "access path: %s, key in %d ranges within [%d, %d]\n", path.c_str(),
+                (int) ranges.size(), minKey, maxKey);
+      } else {
+        fprintf(stdout, "access path: %s, key in [%d, %d]\n", path.c_str(), minKey, maxKey);
+      }
+      if(costed) {
+        fprintf(stdout, "estimated rows: %.1f of %d\n", estRows, catalog->getRowCount());
+        fprintf(stdout, "estimated cost: index %.1f, table scan %.1f\n", indexCost, scanCost);
+      }
+      if(order.attr != 0 && attr <= 3) {
+        string how;
+        if(!needSort) {
+          how = indexOrder && order.desc ? "reverse index order" : "index order";
+        } else if(limited) {
+          char heap[48];
+          sprintf(heap, "top-%d heap", order.limit);
+          how = heap;
         } else {
-          // We have a range that doesn't begin,
-          // so we will use the minimum int
-          minKey = std::numeric_limits<int>::min();
+          how = "sort, merging runs spilled to disk if they do not fit in memory";
         }
-        if(ltExists) {
-          if(ltNotLte) {
-            maxKey = ltKey - 1;
-          } else {
-            maxKey = ltKey;
+        fprintf(stdout, "order by %s %s: %s\n", order.attr == 1 ? "key" : "value",
+                order.desc ? "desc" : "asc", how.c_str());
+      }
+      if(limited && !needSort) {
+        fprintf(stdout, "limit: stop after %d rows\n", order.limit);
+      }
+      if(grouped) {
+        fprintf(stdout, "group by value: hash aggregate, partitions spilled to disk past %d groups\n",
+                HashAggregate::MEMORY_GROUPS);
+        if(order.attr != 0) {
+          string how = "sort";
+          if(order.limit >= 0) {
+            char heap[48];
+            sprintf(heap, "top-%d heap", order.limit);
+            how = heap;
           }
-        } else {
-          maxKey = std::numeric_limits<int>::max();
+          fprintf(stdout, "order by %s %s: %s\n", order.attr == 2 ? "value" : "count(*)",
+                  order.desc ? "desc" : "asc", how.c_str());
+        } else if(order.limit >= 0) {
+          fprintf(stdout, "limit: stop after %d groups\n", order.limit);
         }
       }
+      rc = 0;
+      goto exit_select;
+    }
 
-      IndexCursor cursor;
-      rc = index.locate(minKey, cursor);
-      if(rc != 0 || cursor.pid == -1) {
-        // Nothing found by locate; no results
+    // Build the plan: an access path reading the candidate tuples, a
+    // filter with all conditions, then the count or the projection,
+    // and the output printing the result
+    Operator*  plan;
+    TupleBatch batch;
+    if(clustered) {
+      // The tuples are in the leaves, so the key range is read with one
+      // walk along them and the whole table needs no walk at all
+      if(attr == 4 && cond.empty()) {
+        count = clusteredIndex.getTupleCount();
         goto maybe_count;
       }
-      for(;;) {
-        if(cursor.pid == -1) {
-          // No more pids
-          break;
-        }
-
-        rc = index.readForward(cursor, key, rid);
-        if(rc != 0) {
-          fprintf(stderr, "Error code %d after readForward attempt with key %d.\n", rc, key);
-          goto exit_select;
-        }
-        if(key > maxKey) {
-          // Past the max range
-          break;
-        }
-
-        if(needValue) {
-          rc = rf.read(rid, key, value);
-          if(rc != 0) {
-            fprintf(stderr, "Error code %d after read attempt with key %d.\n", rc, key);
+      plan = new ClusteredScan(clusteredIndex, minKey, maxKey);
+    } else if(validIndex && useIndex) {
+      // A count that only depends on the key comes from the entry counts
+      // kept in the B+tree, without walking the leaves, summed over the
+      // key ranges
+      if(attr == 4 && !needValue && resident == NULL && !useHash) {
+        for(unsigned i = 0; i < ranges.size(); i++) {
+          int rangeCount;
+          if((rc = index.countRange(ranges[i].lo, ranges[i].hi, rangeCount)) != 0) {
+            fprintf(stderr, "Error code %d while counting the key range.\n", rc);
             goto exit_select;
           }
+          count += rangeCount;
         }
-
-        // check the value/not-equal conditions on the tuple
-        for (unsigned i = 0; i < cond.size(); i++) {
-          if(cond[i].attr == 1 && cond[i].comp == SelCond::NE) {
-            // We only need to check the not-equals for the key conditions
-            if(atoi(cond[i].value) == key) {
-              // The current key is the not-equal key
-              goto next_tup2;
-            }
-          } else if(cond[i].attr == 2) {
-            // We know that 'value' has been set, since we previously
-            // checked for any conditions with attribute 2
-            diff = strcmp(value.c_str(), cond[i].value);
-            // skip the tuple if any condition is not met
-            switch (cond[i].comp) {
-              case SelCond::EQ:
-                if (diff != 0) goto next_tup2;
-                break;
-              case SelCond::NE:
-                if (diff == 0) goto next_tup2;
-                break;
-              case SelCond::GT:
-                if (diff <= 0) goto next_tup2;
-                break;
-              case SelCond::LT:
-                if (diff >= 0) goto next_tup2;
-                break;
-              case SelCond::GE:
-                if (diff < 0) goto next_tup2;
-                break;
-              case SelCond::LE:
-                if (diff > 0) goto next_tup2;
-                break;
-            }
-          }
-        }
-
-        // the condition is met for the tuple.
-        // increase matching tuple counter
-        count++;
-
-        // print the tuple
-        if(attr == 1) {
-          fprintf(stdout, "%d\n", key);
-        } else if(attr == 2) {
-           fprintf(stdout, "%s\n", value.c_str());
-        } else if(attr == 3) {
-           fprintf(stdout, "%d '%s'\n", key, value.c_str());
-        }
-
-        next_tup2:
-        if(key == maxKey) {
-          // We already made sure key was not greater than maxKey
-          // But if it is equal then we want to finish now since
-          // there are no duplicates
-          break;
-        }
+        goto maybe_count;
+      }
+      if(keyBound && !useHash) {
+        // The minimum or the maximum key is the first entry of the scan
+        // from the bottom of the key ranges, or from their top backwards
+        plan = new IndexRangeScan(resident == NULL ? &index : NULL, resident, rf,
+                                  ranges, false, false, attr == 6, 1);
+      } else if(useHash) {
+        // The hash index finds the tuples of the keys directly
+        vector<int> keys(ranges.size());
+        for(unsigned i = 0; i < ranges.size(); i++) keys[i] = ranges[i].lo;
+        plan = new KeyLookup(hashIndex, rf, keys, needValue);
+      } else {
+        // When the values of a range of keys are needed, reading the
+        // record of every index entry as it comes would jump around the
+        // table and read the same pages over and over, so the scan
+        // fetches them in page order instead
+        plan = new IndexRangeScan(resident == NULL ? &index : NULL, resident, rf,
+                                  ranges, needValue, sortedFetch,
+                                  indexOrder && order.desc, indexLimit);
       }
+    } else if(useValueIndex) {
+      plan = new ValueIndexScan(valueIndex, rf, pred.hasValueLo(), pred.getValueLo(),
+                                pred.hasValueHi(), pred.getValueHi());
+    } else if(parallel) {
+      // The workers filter, and count, the tuples of their own morsels
+      plan = new ParallelScan(rf, pred, pred.hasKeyRange(), needValue, attr == 4, numWorkers);
     } else {
-      // scan the table file from the beginning
-      rid.pid = rid.sid = 0;
-      while (rid < rf.endRid()) {
-        // read the tuple
-        if ((rc = rf.read(rid, key, value)) < 0) {
-          fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-          goto exit_select;
-        }
-
-        // check the conditions on the tuple
-        for (unsigned i = 0; i < cond.size(); i++) {
-          // compute the difference between the tuple value and the condition value
-          switch (cond[i].attr) {
-            case 1:
-              diff = key - atoi(cond[i].value);
-              break;
-            case 2:
-              diff = strcmp(value.c_str(), cond[i].value);
-              break;
-          }
-
-          // skip the tuple if any condition is not met
-          switch (cond[i].comp) {
-            case SelCond::EQ:
-              if (diff != 0) goto next_tuple;
-              break;
-            case SelCond::NE:
-              if (diff == 0) goto next_tuple;
-              break;
-            case SelCond::GT:
-              if (diff <= 0) goto next_tuple;
-              break;
-            case SelCond::LT:
-              if (diff >= 0) goto next_tuple;
-              break;
-            case SelCond::GE:
-              if (diff < 0) goto next_tuple;
-              break;
-            case SelCond::LE:
-              if (diff > 0) goto next_tuple;
-              break;
-          }
-        }
-
-        // the condition is met for the tuple.
-        // increase matching tuple counter
-        count++;
-
-        // print the tuple
-        switch (attr) {
-          case 1:  // SELECT key
-            fprintf(stdout, "%d\n", key);
-            break;
-          case 2:  // SELECT value
-            fprintf(stdout, "%s\n", value.c_str());
-            break;
-          case 3:  // SELECT *
-            fprintf(stdout, "%d '%s'\n", key, value.c_str());
-            break;
-        }
-
-        // move to the next tuple
-        next_tuple:
-        ++rid;
+      plan = new TableScan(rf, pred, pred.hasKeyRange());
+    }
+    if(!cond.empty() && !parallel) plan = new Filter(plan, pred);
+    if(attr == 4) {
+      if(!parallel) plan = new Count(plan);
+    } else if(grouped) {
+      // The tuples are counted by value in a hash table, and the groups
+      // ordered by value or by count
+      plan = new HashAggregate(plan);
+      if(order.attr != 0) {
+        plan = new Sort(plan, order.attr == 2, order.desc, order.limit);
+      } else if(order.limit >= 0) {
+        plan = new Limit(plan, order.limit);
       }
+    } else if(attr >= 5) {
+      plan = new Aggregate(plan, attr);
+    } else {
+      if(needSort) {
+        plan = new Sort(plan, order.attr == 2, order.desc, order.limit);
+      } else if(limited) {
+        plan = new Limit(plan, order.limit);
+      }
+      plan = new Project(plan, attr);
     }
+    plan = new Output(plan, attr);
+
+    do {
+      rc = plan->next(batch);
+    } while(rc == 0 && batch.size() > 0);
+    delete plan;
+    if(rc < 0) {
+      fprintf(stderr, "Error code %d while reading table %s\n", rc, table.c_str());
+    }
+    goto exit_select;
   }
 
   maybe_count:
-  // print matching tuple count if "select count(*)"
+  // print matching tuple count if "select count(*)"; any other aggregate
+  // of no tuples is NULL, and no tuples make no groups
   if (attr == 4) {
     fprintf(stdout, "%d\n", count);
+  } else if (attr >= 5 && !grouped) {
+    fprintf(stdout, "NULL\n");
   }
   rc = 0;
 
   // close the table file and return
   exit_select:
-  index.close();
+  if(clustered) {
+    clusteredIndex.close();
+    return rc;
+  } else if(useValueIndex) {
+    valueIndex.close();
+  } else if(useHash) {
+    hashIndex.close();
+  } else {
+    index.close();
+  }
   rf.close();
   return rc;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+// A table of a join: its files and indexes, the conditions on it, and
+// the estimated cost of reading the tuples that meet them
+struct JoinTable {
+  string              name;
+  bool                opened;
+  bool                clustered;
+  RecordFile          rf;
+  BTreeIndex          index;
+  HashIndex           hashIndex;
+  ValueIndex          valueIndex;
+  ClusteredIndex      clusteredIndex;
+  ArtIndex*           resident;
+  bool                hasTree;
+  bool                hasHash;
+  bool                hasValueIndex;
+  const TableCatalog* catalog;
+  vector<SelCond>     cond;
+  Predicate*          pred;
+  bool                needValue;
+
+  double              rows;         // the tuples expected to meet the conditions
+  double              accessCost;   // reading them in any order
+  bool                useIndex;     // whether the index is cheaper for that
+  double              orderedCost;  // reading them in key order, for a merge join
+  double              lookupCost;   // finding the tuples of one key or value in
+                                    // the index on the joined column
+
+  JoinTable() : opened(false), clustered(false), resident(NULL), hasTree(false),
+                hasHash(false), hasValueIndex(false), catalog(NULL), pred(NULL),
+                needValue(false) {}
+  ~JoinTable()
+  {
+    delete pred;
+    if (!opened) return;
+    if (clustered) {
+      clusteredIndex.close();
+      return;
+    }
+    if (hasTree) index.close();
+    if (hasHash) hashIndex.close();
+    if (hasValueIndex) valueIndex.close();
+    rf.close();
+  }
+};
+
+// the cost of reading the rows of a table that meet its conditions, in
+// any order and in key order, and of looking up one key or value of the
+// joined column
+static void estimateJoinTable(JoinTable& t, int attr)
+{
+  const double INFINITE = numeric_limits<double>::max();
+  const vector<KeyRange>& ranges = t.pred->getKeyRanges();
+  bool   ordered = t.clustered || t.hasTree || t.resident != NULL;
+  double pages;
+  double total;
+
+  if (t.clustered) {
+    total = t.clusteredIndex.getTupleCount();
+    pages = ceil(total / RecordFile::RECORDS_PER_PAGE);
+  } else if (t.catalog != NULL) {
+    total = t.catalog->getRowCount();
+    pages = t.catalog->getPageCount();
+  } else {
+    pages = t.rf.endRid().pid + 1;
+    total = pages * RecordFile::RECORDS_PER_PAGE;
+  }
+
+  // the catalog keeps the key distribution; a clustered table is assumed
+  // to spread its keys evenly over the range the conditions allow
+  t.rows = 0;
+  if (t.catalog != NULL) {
+    for (unsigned i = 0; i < ranges.size(); i++) {
+      t.rows += t.catalog->estimateRange(ranges[i].lo, ranges[i].hi);
+    }
+  } else {
+    t.rows = total;
+  }
+
+  double scanCost = pages + total * TUPLE_CPU_COST;
+  t.useIndex    = false;
+  t.accessCost  = scanCost;
+  t.orderedCost = INFINITE;
+  if (t.clustered) {
+    t.orderedCost = t.pred->hasKeyRange() ? pages * t.rows / max(1.0, total) + 1 : scanCost;
+    t.accessCost  = t.orderedCost;
+  } else if (ordered && t.catalog != NULL) {
+    const BTreeIndex* tree = t.resident == NULL ? &t.index : NULL;
+    t.orderedCost = estimateIndexCost(*t.catalog, tree, t.rows, t.needValue, false);
+    double indexCost = estimateIndexCost(*t.catalog, tree, t.rows, t.needValue, t.needValue);
+    if ((t.pred->hasKeyRange() || !t.needValue) && indexCost < scanCost) {
+      t.useIndex   = true;
+      t.accessCost = indexCost;
+    }
+  }
+
+  // a lookup descends the index, and reads the record for its value
+  double fetch = t.needValue ? 1 : 0;
+  t.lookupCost = INFINITE;
+  if (attr == 2) {
+    if (t.hasValueIndex) t.lookupCost = 3 + fetch;
+  } else if (t.clustered) {
+    t.lookupCost = max(1.0, ceil(log(max(2.0, pages)) / log(8.0)));
+  } else if (t.resident != NULL) {
+    t.lookupCost = fetch + TUPLE_CPU_COST;
+  } else if (t.hasHash) {
+    t.lookupCost = 1 + fetch;
+  } else if (t.hasTree) {
+    t.lookupCost = t.index.getTreeHeight() + fetch;
+  }
+}
+
+// the operator reading the tuples of a table of a join that meet its
+// conditions, in key order if ordered is set
+static Operator* joinAccessPath(JoinTable& t, bool ordered)
+{
+  Operator* plan;
+  if (t.clustered) {
+    plan = new ClusteredScan(t.clusteredIndex, t.pred->getMinKey(), t.pred->getMaxKey());
+  } else if (ordered || t.useIndex) {
+    plan = new IndexRangeScan(t.resident == NULL ? &t.index : NULL, t.resident, t.rf,
+                              t.pred->getKeyRanges(), t.needValue, !ordered && t.needValue);
+  } else {
+    plan = new TableScan(t.rf, *t.pred, t.pred->hasKeyRange());
+  }
+  if (!t.cond.empty()) plan = new Filter(plan, *t.pred);
+  return plan;
+}
+
+RC SqlEngine::join(int attr, const vector<JoinColumn>& columns, const string& left,
+                   const string& right, const vector<JoinCond>& conds, bool explain)
+{
+  RC rc;
+
+  if (left == right) {
+    fprintf(stderr, "Error: a table cannot be joined with itself\n");
+    return RC_INVALID_ATTRIBUTE;
+  }
+
+  // Sort the conditions out: the first equality of a column of one table
+  // with the same column of the other is the join condition, the other
+  // comparisons of two columns are checked on the joined rows, and the
+  // comparisons with a constant go to the table they are on
+  JoinTable           tables[2];
+  vector<JoinCompare> compares;
+  int                 joinAttr = 0;
+  tables[0].name = left;
+  tables[1].name = right;
+  for (unsigned i = 0; i < conds.size(); i++) {
+    const JoinCond& c = conds[i];
+    int side  = c.column.table == left ? 0 : (c.column.table == right ? 1 : -1);
+    int other = c.value != NULL ? 0 : (c.other.table == left ? 0 : (c.other.table == right ? 1 : -1));
+    if (side < 0 || other < 0) {
+      fprintf(stderr, "Error: table %s is not in the FROM clause\n",
+              side < 0 ? c.column.table : c.other.table);
+      return RC_INVALID_ATTRIBUTE;
+    }
+    if (c.value != NULL) {
+      SelCond cond = {c.column.attr, c.comp, c.value, 0};
+      tables[side].cond.push_back(cond);
+      continue;
+    }
+    if (side == other) {
+      fprintf(stderr, "Error: a condition compares two columns of table %s\n", c.column.table);
+      return RC_INVALID_ATTRIBUTE;
+    }
+    if (c.column.attr != c.other.attr) {
+      fprintf(stderr, "Error: a key can only be compared with a key, and a value with a value\n");
+      return RC_INVALID_ATTRIBUTE;
+    }
+    if (joinAttr == 0 && c.comp == SelCond::EQ) {
+      joinAttr = c.column.attr;
+    } else {
+      JoinField a = {side, c.column.attr};
+      JoinField b = {other, c.other.attr};
+      JoinCompare compare = {a, c.comp, b};
+      compares.push_back(compare);
+    }
+  }
+  if (joinAttr == 0) {
+    fprintf(stderr, "Error: a join needs a condition %s.key = %s.key or %s.value = %s.value\n",
+            left.c_str(), right.c_str(), left.c_str(), right.c_str());
+    return RC_INVALID_ATTRIBUTE;
+  }
+
+  // the columns printed
+  vector<JoinField> fields;
+  if (attr == 3) {
+    for (int side = 0; side < 2; side++) {
+      JoinField key = {side, 1}, value = {side, 2};
+      fields.push_back(key);
+      fields.push_back(value);
+    }
+  } else if (attr == 0) {
+    for (unsigned i = 0; i < columns.size(); i++) {
+      int side = columns[i].table == left ? 0 : (columns[i].table == right ? 1 : -1);
+      if (side < 0) {
+        fprintf(stderr, "Error: table %s is not in the FROM clause\n", columns[i].table);
+        return RC_INVALID_ATTRIBUTE;
+      }
+      JoinField field = {side, columns[i].attr};
+      fields.push_back(field);
+    }
+  }
+
+  // On a join of the keys, a key condition on one table holds for the
+  // other as well, so both read only the keys that can join
+  if (joinAttr == 1) {
+    vector<SelCond> keyConds[2];
+    for (int side = 0; side < 2; side++) {
+      for (unsigned i = 0; i < tables[side].cond.size(); i++) {
+        if (tables[side].cond[i].attr == 1) keyConds[side].push_back(tables[side].cond[i]);
+      }
+    }
+    for (int side = 0; side < 2; side++) {
+      vector<SelCond>& cond = tables[side].cond;
+      cond.insert(cond.end(), keyConds[1 - side].begin(), keyConds[1 - side].end());
+    }
+  }
+
+  // open both tables and every index they have that a join can use
+  bool noResults = false;
+  for (int side = 0; side < 2; side++) {
+    JoinTable& t = tables[side];
+    t.clustered = fileExists(t.name + ".iot");
+    if (t.clustered) {
+      if ((rc = openClusteredIndex(t.name, t.clusteredIndex)) != 0) return rc;
+      t.opened = true;
+    } else {
+      if ((rc = t.rf.open(t.name + ".tbl", 'r')) < 0) {
+        fprintf(stderr, "Error: table %s does not exist\n", t.name.c_str());
+        return rc;
+      }
+      t.opened  = true;
+      t.catalog = getCatalog(t.name);
+      map<string, ArtIndex*>::iterator pinned = residentIndexes.find(t.name);
+      if (pinned != residentIndexes.end()) {
+        t.resident = pinned->second;
+      } else if ((rc = openKeyIndex(t.name, t.index, t.hasTree)) != 0) {
+        return rc;
+      }
+      if (joinAttr == 1 && fileExists(t.name + ".hsh")) {
+        if ((rc = t.hashIndex.open(t.name + ".hsh", 'r')) != 0) return rc;
+        t.hasHash = true;
+      }
+      if (joinAttr == 2 && fileExists(t.name + ".vdx")) {
+        if ((rc = t.valueIndex.open(t.name + ".vdx", 'r')) != 0) return rc;
+        t.hasValueIndex = true;
+      }
+    }
+
+    t.pred      = new Predicate(t.cond);
+    t.needValue = joinAttr == 2 || t.pred->hasValueConds();
+    for (unsigned i = 0; i < fields.size(); i++) {
+      if (fields[i].side == side && fields[i].attr == 2) t.needValue = true;
+    }
+    for (unsigned i = 0; i < compares.size(); i++) {
+      if (compares[i].left.attr == 2) t.needValue = true;
+    }
+    if (t.pred->isEmpty()) noResults = true;
+    estimateJoinTable(t, joinAttr);
+  }
+
+  // Weigh the join methods: a merge join reads both tables in key order,
+  // an index nested loops join reads the outer table and looks up every
+  // tuple of it in the index of the inner one, and a hash join reads both
+  // tables in any order, writing them out once and reading them back once
+  // more if the smaller one does not fit in memory
+  const double INFINITE = numeric_limits<double>::max();
+  double mergeCost = INFINITE;
+  double loopCost[2];
+  double hashCost;
+  int    buildSide = tables[0].rows <= tables[1].rows ? 0 : 1;
+  bool   spills    = tables[buildSide].rows > HashJoin::MEMORY_TUPLES;
+
+  if (joinAttr == 1 && tables[0].orderedCost < INFINITE && tables[1].orderedCost < INFINITE) {
+    mergeCost = tables[0].orderedCost + tables[1].orderedCost;
+  }
+  for (int side = 0; side < 2; side++) {
+    const JoinTable& inner = tables[1 - side];
+    loopCost[side] = inner.lookupCost == INFINITE ? INFINITE
+                     : tables[side].accessCost + tables[side].rows * inner.lookupCost;
+  }
+  hashCost = tables[0].accessCost + tables[1].accessCost;
+  if (spills) {
+    for (int side = 0; side < 2; side++) {
+      double width = sizeof(int) * 2 + (tables[side].needValue && tables[side].catalog != NULL
+                                        ? tables[side].catalog->getAvgValueLength() : 0);
+      hashCost += 2 * ceil(tables[side].rows * width / PageFile::PAGE_SIZE);
+    }
+  }
+
+  int outerSide = loopCost[0] <= loopCost[1] ? 0 : 1;
+  enum { MERGE, NESTED_LOOPS, HASH } method = HASH;
+  if (mergeCost <= hashCost && mergeCost <= loopCost[outerSide]) {
+    method = MERGE;
+  } else if (loopCost[outerSide] < hashCost) {
+    method = NESTED_LOOPS;
+  }
+
+  if (explain) {
+    if (noResults) {
+      fprintf(stdout, "join method: none, the conditions cannot match\n");
+      return 0;
+    }
+    const char* joined = joinAttr == 1 ? "key" : "value";
+    if (method == MERGE) {
+      fprintf(stdout, "join method: merge join on the key, reading %s and %s in key order\n",
+              left.c_str(), right.c_str());
+    } else if (method == NESTED_LOOPS) {
+      const JoinTable& inner = tables[1 - outerSide];
+      const char* index = joinAttr == 2 ? "value index"
+                          : inner.clustered ? "clustered index"
+                          : inner.resident != NULL ? "memory-resident index"
+                          : inner.hasHash ? "hash index" : "B+tree";
+      fprintf(stdout, "join method: index nested loops join on the %s, %s outer, "
+              "looking up %s in its %s\n", joined, tables[outerSide].name.c_str(),
+              inner.name.c_str(), index);
+    } else {
+      fprintf(stdout, "join method: hash join on the %s, building on %s", joined,
+              tables[buildSide].name.c_str());
+      if (spills) {
+        fprintf(stdout, ", spilling both tables into %d partitions", HashJoin::PARTITIONS);
+      }
+      fprintf(stdout, "\n");
+    }
+    fprintf(stdout, "estimated rows: %s %.1f, %s %.1f\n", left.c_str(), tables[0].rows,
+            right.c_str(), tables[1].rows);
+    fprintf(stdout, "estimated cost: hash %.1f", hashCost);
+    if (mergeCost < INFINITE) fprintf(stdout, ", merge %.1f", mergeCost);
+    for (int side = 0; side < 2; side++) {
+      if (loopCost[side] < INFINITE) {
+        fprintf(stdout, ", nested loops with %s outer %.1f", tables[side].name.c_str(),
+                loopCost[side]);
+      }
+    }
+    fprintf(stdout, "\n");
+    return 0;
+  }
+
+  // Build the plan: the join over an access path on each table, which
+  // filters its tuples with the conditions on it, then the comparisons of
+  // the columns of both tables, and the output
+  JoinOperator* plan;
+  JoinBatch     batch;
+  if (noResults) {
+    if (attr == 4) fprintf(stdout, "0\n");
+    return 0;
+  }
+  if (method == MERGE) {
+    plan = new MergeJoin(joinAccessPath(tables[0], true), joinAccessPath(tables[1], true));
+  } else if (method == NESTED_LOOPS) {
+    JoinTable&                 t = tables[1 - outerSide];
+    IndexNestedLoopJoin::Inner inner = {NULL, NULL, NULL, NULL, NULL, &t.rf, t.pred, t.needValue};
+    if (joinAttr == 2) {
+      inner.valueIndex = &t.valueIndex;
+    } else if (t.clustered) {
+      inner.clustered = &t.clusteredIndex;
+    } else if (t.resident != NULL) {
+      inner.resident = t.resident;
+    } else if (t.hasHash) {
+      inner.hash = &t.hashIndex;
+    } else {
+      inner.tree = &t.index;
+    }
+    plan = new IndexNestedLoopJoin(joinAccessPath(tables[outerSide], false), outerSide,
+                                   joinAttr, inner);
+  } else {
+    plan = new HashJoin(joinAccessPath(tables[buildSide], false),
+                        joinAccessPath(tables[1 - buildSide], false), buildSide, joinAttr);
+  }
+  if (!compares.empty()) plan = new JoinFilter(plan, compares);
+  plan = new JoinOutput(plan, fields, attr == 4);
+
+  do {
+    rc = plan->next(batch);
+  } while (rc == 0 && batch.count > 0);
+  delete plan;
+  if (rc < 0) {
+    fprintf(stderr, "Error code %d while joining tables %s and %s\n", rc, left.c_str(),
+            right.c_str());
+  }
+  return rc;
+}
+
+RC SqlEngine::load(const string& table, const string& loadfile, IndexType index)
 {
   RecordFile rf;
   RecordId rid;
   int result;
 
-  BTreeIndex possibleIndex;
-  if(index) {
-    result = possibleIndex.open(table + ".idx", 'w');
+  // A clustered table stays clustered
+  if(index == CLUSTERED_INDEX || fileExists(table + ".iot")) {
+    return loadClustered(table, loadfile);
+  }
+
+  // Once a table has a hash index, every load keeps it up to date.
+  // A new hash index also has to cover the rows already in the table.
+  HashIndex hashIndex;
+  bool      hashed    = index == HASH_INDEX || fileExists(table + ".hsh");
+  bool      newHashed = index == HASH_INDEX && !fileExists(table + ".hsh");
+  if(hashed) {
+    result = hashIndex.open(table + ".hsh", 'w');
     if(result != 0) return result;
   }
 
   result = rf.open(table + ".tbl", 'w');
   if(result != 0) return result;
   
-  ifstream input(loadfile.c_str());
-  if(!input) {
+  // The load file is parsed by worker threads, a chunk at a time, ahead
+  // of the appends below, which take the tuples in file order
+  LoadFile input;
+  if(input.open(loadfile, WorkerPool::processorCount()) != 0) {
     // Error
     return -5;
   }
-  string line;
   int key;
   string value;
-  while(getline(input, line)) {
-    result = parseLoadLine(line, key, value);
+  bool found;
+
+  // A bloom filter missing keys of the table would hide them from point
+  // lookups, so the old one goes before the first append. It is rebuilt
+  // at the end; if the load fails first, select does without one.
+  remove((table + ".blm").c_str());
+
+  // The same goes for the statistics in the catalog: without them the
+  // row count and the key range come from the table itself
+  catalogs.erase(table);
+  remove((table + ".cat").c_str());
+
+  // Remember every key in the table for the bloom filter, and every
+  // (key, rid) pair if the table has or gets an index. If we are
+  // appending to an existing table, its current rows are needed too.
+  // The value index, if there is one, is rebuilt the same way, and so
+  // are the table statistics in the catalog.
+  TableCatalog       catalog;
+  vector<int>        keys;
+  vector<IndexEntry> entries;
+  vector<ValueEntry> valueEntries;
+  bool               valueIndexed = fileExists(table + ".vdx");
+  bool               bulkIndexed  = index == BTREE_INDEX || index == LEARNED_INDEX
+                                    || fileExists(table + ".idx");
+  for(rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid) {
+    result = rf.read(rid, key, value);
     if(result != 0) return result;
+    keys.push_back(key);
+    catalog.addTuple(key, value);
+    if(valueIndexed) {
+      ValueEntry entry;
+      ValueIndex::makeEntry(value, key, rid, entry);
+      valueEntries.push_back(entry);
+    }
+    if(bulkIndexed) {
+      IndexEntry entry = {key, rid};
+      entries.push_back(entry);
+    }
+    if(newHashed) {
+      result = hashIndex.insert(key, rid);
+      if(result != 0) return result;
+    }
+  }
 
+  // A bad line or a failed append ends the load, but the rows appended
+  // before it stay in the table. The index and the other files are still
+  // built over them below, and the error is returned at the end.
+  size_t firstNew = entries.size();
+  RC     loadRc;
+  while((loadRc = input.next(key, value, found)) == 0 && found) {
     result = rf.append(key, value, rid);
     if(result != 0) {
       fprintf(stderr, "Append of key %d failed in load\n", key);
-      return result;
+      loadRc = result;
+      break;
+    }
+    keys.push_back(key);
+    catalog.addTuple(key, value);
+    if(valueIndexed) {
+      ValueEntry entry;
+      ValueIndex::makeEntry(value, key, rid, entry);
+      valueEntries.push_back(entry);
+    }
+
+    if(bulkIndexed) {
+      IndexEntry entry = {key, rid};
+      entries.push_back(entry);
     }
 
-    if(index) {
-      result = possibleIndex.insert(key, rid);
+    if(hashed) {
+      result = hashIndex.insert(key, rid);
       if(result != 0) {
-        fprintf(stderr, "Insert of key %d, pid %d failed in load\n", key, rid.pid);
-        return result;
+        fprintf(stderr, "Hash insert of key %d, pid %d failed in load\n", key, rid.pid);
+        loadRc = result;
+        break;
       }
     }
   }
-  if(index) {
-    result = possibleIndex.close();
+
+  // The B+tree is built in one go over the sorted entries of the whole
+  // table, on the index stage, while the other files are written here.
+  // Leaving this function waits for the stage.
+  IndexBuild indexBuild(table, entries, firstNew, index);
+  WorkerPool indexStage;
+  if(bulkIndexed) {
+    result = indexStage.start(&indexBuild, 1, 1);
+    if(result != 0) return result;
+  }
+
+  if(hashed) {
+    result = hashIndex.close();
+    if(result != 0) return result;
+  }
+
+  if(valueIndexed) {
+    ValueIndex valueIndex;
+    remove((table + ".vdx").c_str());
+    result = valueIndex.open(table + ".vdx", 'w');
+    if(result != 0) return result;
+    result = valueIndex.build(valueEntries);
+    if(result != 0) {
+      fprintf(stderr, "Building the value index failed in load\n");
+      return result;
+    }
+    result = valueIndex.close();
+    if(result != 0) return result;
+  }
+
+  // Rebuild the bloom filter from scratch; a filter cannot be resized
+  BloomFilter filter;
+  result = filter.open(table + ".blm", 'w');
+  if(result != 0) return result;
+  result = filter.build(keys);
+  if(result != 0) {
+    fprintf(stderr, "Building the bloom filter failed in load\n");
+    filter.close();
+    remove((table + ".blm").c_str());
+    return result;
+  }
+  result = filter.close();
+  if(result != 0) return result;
+
+  // The page count covers a partially filled last page
+  rid = rf.endRid();
+  catalog.finish(rid.pid + (rid.sid > 0 ? 1 : 0));
+  result = catalog.write(table);
+  if(result != 0) {
+    fprintf(stderr, "Writing the catalog failed in load\n");
+    remove((table + ".cat").c_str());
+    return result;
+  }
+  catalogs[table] = catalog;
+
+  indexStage.wait();
+  if(indexBuild.rc != 0) {
+    fprintf(stderr, "Building the index failed in load\n");
+    return indexBuild.rc;
+  }
+
+  result = rf.close();
+  if(result != 0) return result;
+
+  // The memory-resident index of a pinned table must see the new tuples
+  if(residentIndexes.count(table) > 0) {
+    result = pin(table);
     if(result != 0) return result;
   }
-  return rf.close();
+  return loadRc;
+}
+
+RC SqlEngine::loadClustered(const string& table, const string& loadfile)
+{
+  ClusteredIndex index;
+  vector<Tuple>  tuples;
+  Tuple          tuple;
+  LoadFile       input;
+  bool           found;
+  RC             rc;
+
+  if(fileExists(table + ".tbl")) {
+    fprintf(stderr, "Error: table %s is not stored as a clustered index\n", table.c_str());
+    return RC_INVALID_FILE_MODE;
+  }
+
+  if(input.open(loadfile, WorkerPool::processorCount()) != 0) {
+    // Error
+    return -5;
+  }
+
+  // Keep the tuples that are already in the table
+  if(fileExists(table + ".iot")) {
+    if((rc = openClusteredIndex(table, index)) < 0) return rc;
+    rc = index.readAll(tuples);
+    index.close();
+    if(rc < 0) return rc;
+  }
+
+  while((rc = input.next(tuple.key, tuple.value, found)) == 0 && found) {
+    tuples.push_back(tuple);
+  }
+  if(rc < 0) return rc;
+
+  // Write the new tree next to the old one and swap it in
+  string tmpname = table + ".iot.tmp";
+  remove(tmpname.c_str());
+  if((rc = index.open(tmpname, 'w')) < 0) return rc;
+  rc = index.build(tuples);
+  if(rc < 0) {
+    fprintf(stderr, "Building the clustered index failed in load\n");
+    index.close();
+    remove(tmpname.c_str());
+    return rc;
+  }
+  if((rc = index.close()) < 0) return rc;
+  if(rename(tmpname.c_str(), (table + ".iot").c_str()) != 0) {
+    remove(tmpname.c_str());
+    return RC_FILE_WRITE_FAILED;
+  }
+  return 0;
+}
+
+RC SqlEngine::createIndex(const string& table, int attr)
+{
+  RecordFile         rf;
+  RecordId           rid;
+  int                key;
+  string             value;
+  vector<IndexEntry> keyEntries;
+  vector<ValueEntry> valueEntries;
+  RC                 rc;
+
+  if (attr != 1 && attr != 2) return RC_INVALID_ATTRIBUTE;
+
+  if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return rc;
+  }
+  for (rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid) {
+    if ((rc = rf.read(rid, key, value)) < 0) {
+      rf.close();
+      return rc;
+    }
+    if (attr == 1) {
+      IndexEntry entry = {key, rid};
+      keyEntries.push_back(entry);
+    } else {
+      ValueEntry entry;
+      ValueIndex::makeEntry(value, key, rid, entry);
+      valueEntries.push_back(entry);
+    }
+  }
+  rf.close();
+
+  if (attr == 1) {
+    BTreeIndex index;
+    sort(keyEntries.begin(), keyEntries.end(), indexEntryLess);
+    remove((table + ".idx").c_str());
+    if ((rc = index.open(table + ".idx", 'w')) < 0) return rc;
+    rc = index.bulkLoad(keyEntries);
+    index.close();
+  } else {
+    ValueIndex index;
+    remove((table + ".vdx").c_str());
+    if ((rc = index.open(table + ".vdx", 'w')) < 0) return rc;
+    rc = index.build(valueEntries);
+    index.close();
+  }
+  if (rc < 0) return rc;
+
+  // The memory-resident index of a pinned table must match the new index
+  if (attr == 1 && residentIndexes.count(table) > 0) {
+    return pin(table);
+  }
+  return 0;
+}
+
+RC SqlEngine::optimizeIndex(const string& table)
+{
+  BTreeIndex         index;
+  vector<IndexEntry> entries;
+  RC                 rc;
+
+  if (!fileExists(table + ".idx")) {
+    fprintf(stderr, "Error: table %s has no index\n", table.c_str());
+    return RC_FILE_OPEN_FAILED;
+  }
+
+  // read the entries of the current index in key order
+  if ((rc = index.open(table + ".idx", 'r')) == RC_INVALID_FILE_FORMAT) {
+    fprintf(stderr, "Error: the index of table %s has an old layout;"
+            " rebuild it with CREATE INDEX ON %s(key)\n", table.c_str(), table.c_str());
+  }
+  if (rc < 0) return rc;
+  rc = index.readAll(entries);
+  bool learned = index.isLearned();
+  index.close();
+  if (rc < 0) return rc;
+
+  // build the reorganized copy from scratch, with a new learned model
+  // if the index had one
+  string tmpname = table + ".idx.tmp";
+  remove(tmpname.c_str());
+  BTreeIndex rebuilt;
+  if ((rc = rebuilt.open(tmpname, 'w')) < 0) return rc;
+  rc = learned ? rebuilt.bulkLoadLearned(entries) : rebuilt.bulkLoad(entries);
+  if (rc < 0) {
+    rebuilt.close();
+    remove(tmpname.c_str());
+    return rc;
+  }
+  if ((rc = rebuilt.close()) < 0) return rc;
+
+  // atomically replace the old index with the new one
+  if (rename(tmpname.c_str(), (table + ".idx").c_str()) != 0) {
+    remove(tmpname.c_str());
+    return RC_FILE_WRITE_FAILED;
+  }
+
+  return 0;
+}
+
+RC SqlEngine::pin(const string& table)
+{
+  vector<IndexEntry> entries;
+  BTreeIndex         index;
+  bool               indexed;
+  RC                 rc;
+
+  if ((rc = openKeyIndex(table, index, indexed)) < 0) return rc;
+  if (indexed) {
+    // the leaf level of the index is already in key order
+    rc = index.readAll(entries);
+    index.close();
+    if (rc < 0) return rc;
+  } else {
+    RecordFile rf;
+    RecordId   rid;
+    int        key;
+    string     value;
+
+    if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+      fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+      return rc;
+    }
+    for (rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid) {
+      if ((rc = rf.read(rid, key, value)) < 0) {
+        rf.close();
+        return rc;
+      }
+      IndexEntry entry = {key, rid};
+      entries.push_back(entry);
+    }
+    rf.close();
+    sort(entries.begin(), entries.end(), indexEntryLess);
+  }
+
+  ArtIndex* resident = new ArtIndex();
+  if ((rc = resident->build(entries)) < 0) {
+    delete resident;
+    return rc;
+  }
+
+  unpin(table);
+  residentIndexes[table] = resident;
+  return 0;
+}
+
+RC SqlEngine::unpin(const string& table)
+{
+  map<string, ArtIndex*>::iterator pinned = residentIndexes.find(table);
+  if (pinned != residentIndexes.end()) {
+    delete pinned->second;
+    residentIndexes.erase(pinned);
+  }
+  return 0;
+}
+
+const TableCatalog* SqlEngine::getCatalog(const string& table)
+{
+  map<string, TableCatalog>::iterator it = catalogs.find(table);
+  if (it == catalogs.end()) {
+    TableCatalog catalog;
+    if (catalog.read(table) != 0) return NULL;
+    it = catalogs.insert(make_pair(table, catalog)).first;
+  }
+  return &it->second;
 }
 
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
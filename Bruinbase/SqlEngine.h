@@ -10,17 +10,51 @@
 #ifndef SQLENGINE_H
 #define SQLENGINE_H
 
+#include <map>
 #include <vector>
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include "TableCatalog.h"
+
+class ArtIndex;
 
 /**
  * data structure to represent a condition in the WHERE clause
  */
 struct SelCond {
   int attr;     // attribute: 1 - key column,  2 - value column
-  enum Comparator { EQ, NE, LT, GT, LE, GE } comp;
-  char* value;  // the value to compare
+  enum Comparator { EQ, NE, LT, GT, LE, GE, IN_KEYS } comp;
+  char* value;  // the value to compare; for IN_KEYS, the keys of
+                // key IN (...) separated by commas
+  int group;    // the conditions of a group are ANDed, and the groups ORed
+};
+
+/**
+ * data structure to represent the ORDER BY and LIMIT clauses
+ */
+struct SelOrder {
+  int  attr;    // attribute: 0 - no ORDER BY, 1 - key column, 2 - value column,
+                // 4 - COUNT(*) of the groups of a GROUP BY value
+  bool desc;    // whether DESC was given
+  int  limit;   // the number of rows in the LIMIT clause, -1 without one
+};
+
+/**
+ * data structure to represent a column of a table in a join, as in a.key
+ */
+struct JoinColumn {
+  char* table;  // the table name
+  int   attr;   // attribute: 1 - key column, 2 - value column
+};
+
+/**
+ * data structure to represent a condition in the WHERE clause of a join
+ */
+struct JoinCond {
+  JoinColumn           column;  // the column on the left of the comparator
+  SelCond::Comparator  comp;
+  char*                value;   // the value to compare with, or NULL
+  JoinColumn           other;   // the column to compare with if value is NULL
 };
 
 /**
@@ -40,24 +74,111 @@ class SqlEngine {
 
   /**
    * executes a SELECT statement.
-   * all conditions in conds must be ANDed together.
+   * the WHERE clause is an OR of groups of ANDed conditions.
    * the result of the SELECT is printed on screen.
    * @param attr[IN] attribute in the SELECT clause
-   * (1: key, 2: value, 3: *, 4: count(*))
+   * (1: key, 2: value, 3: *, 4: count(*), 5: MIN(key), 6: MAX(key),
+   * 7: SUM(key), 8: AVG(key), 9: MIN(value), 10: MAX(value); with
+   * GROUP BY value, 11: value, COUNT(*), 12: value)
    * @param table[IN] the table name in the FROM clause
    * @param conds[IN] list of conditions in the WHERE clause
+   * @param order[IN] the ORDER BY and LIMIT clauses
+   * @param explain[IN] print the chosen access path and its estimated
+   * cost instead of running the query
+   * @return error code. 0 if no error
+   */
+  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds,
+                   const SelOrder& order, bool explain = false);
+
+  /**
+   * executes a SELECT statement over two tables joined on their keys or
+   * on their values.
+   * the WHERE clause is an AND of conditions. exactly one of them must
+   * equate a column of one table with the same column of the other; the
+   * others either compare a column with a constant or two columns.
+   * the join is run as a merge join over the indexes of both tables, a
+   * hash join, or an index nested loops join, whichever is estimated to
+   * read the fewest pages. the result is printed on screen.
+   * @param attr[IN] attribute in the SELECT clause (0: the columns in
+   * columns, 3: *, 4: count(*))
+   * @param columns[IN] the columns in the SELECT clause if attr is 0
+   * @param left[IN] the first table name in the FROM clause
+   * @param right[IN] the second table name in the FROM clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @param explain[IN] print the chosen join method and its estimated
+   * cost instead of running the query
    * @return error code. 0 if no error
    */
-  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
+  static RC join(int attr, const std::vector<JoinColumn>& columns, const std::string& left,
+                 const std::string& right, const std::vector<JoinCond>& conds,
+                 bool explain = false);
+
+  /**
+   * the kind of index built by the LOAD command
+   */
+  enum IndexType {
+    NO_INDEX,       // no WITH clause; an existing B+tree or learned
+                    // index is kept up to date
+    BTREE_INDEX,    // WITH INDEX: a B+tree bulk-loaded over the sorted
+                    // keys of the whole table
+    LEARNED_INDEX,  // WITH LEARNED INDEX: a bulk-loaded B+tree whose
+                    // lookups are served by a piecewise-linear model
+    HASH_INDEX,     // WITH HASH INDEX: a linear hash index for key
+                    // equality lookups, kept up to date by later loads
+    CLUSTERED_INDEX // WITH CLUSTERED INDEX: the table is stored in the
+                    // leaves of a B+tree instead of a RecordFile
+  };
 
   /**
    * load a table from a load file.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
-   * @param index[IN] true if "WITH INDEX" option was specified
+   * @param index[IN] the kind of index given in the "WITH ... INDEX" option
+   * @return error code. 0 if no error
+   */
+  static RC load(const std::string& table, const std::string& loadfile, IndexType index);
+
+  /**
+   * build an index on a column of a table from the tuples in the table,
+   * replacing any index the table had on that column.
+   * the key column gets a bulk-loaded B+tree like the one LOAD ... WITH
+   * INDEX builds; the value column gets a secondary B+tree over value
+   * prefixes, which select() uses for conditions on the value and which
+   * later loads into the table keep up to date.
+   * @param table[IN] the table name in the CREATE INDEX command
+   * @param attr[IN] the indexed column (1: key, 2: value)
+   * @return error code. 0 if no error
+   */
+  static RC createIndex(const std::string& table, int attr);
+
+  /**
+   * rebuild the index of a table so that its leaf nodes are stored
+   * contiguously in key order. a learned index keeps its learned model.
+   * the new index is written to a temporary file next to the old one and
+   * then renamed over it, so the old index stays usable until the swap.
+   * @param table[IN] the table name in the OPTIMIZE INDEX command
+   * @return error code. 0 if no error
+   */
+  static RC optimizeIndex(const std::string& table);
+
+  /**
+   * make the index of a table memory-resident.
+   * an in-memory adaptive radix tree is built over the keys of the table,
+   * from the leaf level of its index if it has one, or from the table
+   * itself otherwise. until the table is unpinned, select() serves key
+   * lookups and key ranges from the tree without reading index pages.
+   * loading more tuples into a pinned table rebuilds its tree.
+   * @param table[IN] the table name in the PIN command
+   * @return error code. 0 if no error
+   */
+  static RC pin(const std::string& table);
+
+  /**
+   * drop the memory-resident index of a table built by pin().
+   * @param table[IN] the table name in the UNPIN command
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC unpin(const std::string& table);
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -67,6 +188,30 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+ private:
+  /**
+   * load a table stored as a clustered index. the tuples already in the
+   * table and those in the load file are sorted together, and the tree
+   * is rebuilt over all of them.
+   * @param table[IN] the table name in the LOAD command
+   * @param loadfile[IN] the file name of the load file
+   * @return error code. 0 if no error
+   */
+  static RC loadClustered(const std::string& table, const std::string& loadfile);
+
+  /**
+   * get the catalog of a table, reading it from disk the first time.
+   * @param table[IN] the table name
+   * @return the catalog, or NULL if the table has none
+   */
+  static const TableCatalog* getCatalog(const std::string& table);
+
+  // the memory-resident indexes of the pinned tables
+  static std::map<std::string, ArtIndex*> residentIndexes;
+
+  // the catalogs read so far; LOAD replaces the entry of its table
+  static std::map<std::string, TableCatalog> catalogs;
 };
 
 #endif /* SQLENGINE_H */
@@ -1,6 +1,7 @@
 %{
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
 #include <sys/times.h>
 #include <climits>
 #include <string>
@@ -12,7 +13,8 @@ int  sqllex(void);
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
 extern "C" { int  sqlwrap() { return 1; } }
 
-static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
+static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds,
+                      const SelOrder& order)
 {
   struct tms tmsbuf;
   clock_t btime, etime;
@@ -20,13 +22,140 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 
   btime = times(&tmsbuf);
   bpagecnt = PageFile::getPageReadCount();
-  SqlEngine::select(attr, table, conds);
+  SqlEngine::select(attr, table, conds, order);
   etime = times(&tmsbuf);
   epagecnt = PageFile::getPageReadCount();
 
   fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
 }
 
+// the attribute of a SELECT with GROUP BY on group (0 if none) passed to
+// SqlEngine::select(): 11 for value, COUNT(*) and 12 for value; 0 if the
+// query is not valid
+static int groupedAttr(int attr, int group)
+{
+  if (group == 0) {
+    if (attr != 11) return attr;
+    sqlerror("value, COUNT(*) needs GROUP BY value");
+    return 0;
+  }
+  if (group != 2) {
+    sqlerror("only GROUP BY value is supported");
+    return 0;
+  }
+  if (attr == 2 || attr == 11) return attr == 2 ? 12 : 11;
+  sqlerror("a GROUP BY value query selects value, or value, COUNT(*)");
+  return 0;
+}
+
+static void runJoin(int attr, const std::vector<JoinColumn>& columns, const char* left,
+                    const char* right, const std::vector<JoinCond>& conds)
+{
+  struct tms tmsbuf;
+  clock_t btime, etime;
+  int     bpagecnt, epagecnt;
+
+  btime = times(&tmsbuf);
+  bpagecnt = PageFile::getPageReadCount();
+  SqlEngine::join(attr, columns, left, right, conds);
+  etime = times(&tmsbuf);
+  epagecnt = PageFile::getPageReadCount();
+
+  fprintf(stderr, "  -- %.3f seconds to run the join command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+}
+
+static void freeColumns(std::vector<JoinColumn>* columns)
+{
+  for (unsigned i = 0; i < columns->size(); i++) {
+    free((*columns)[i].table);
+  }
+  delete columns;
+}
+
+static void freeJoinConditions(std::vector<JoinCond>* conds)
+{
+  for (unsigned i = 0; i < conds->size(); i++) {
+    free((*conds)[i].column.table);
+    free((*conds)[i].value);
+    free((*conds)[i].other.table);
+  }
+  delete conds;
+}
+
+// the number of groups in a list of conditions
+static int countGroups(const std::vector<SelCond>& conds)
+{
+  int n = 0;
+  for (unsigned i = 0; i < conds.size(); i++) {
+    if (conds[i].group >= n) n = conds[i].group + 1;
+  }
+  return n;
+}
+
+static void freeConditions(std::vector<SelCond>* conds)
+{
+  for (unsigned i = 0; i < conds->size(); i++) {
+    free((*conds)[i].value);
+  }
+  delete conds;
+}
+
+// the OR of two lists of conditions: the groups of both
+static std::vector<SelCond>* orConditions(std::vector<SelCond>* a, std::vector<SelCond>* b)
+{
+  int offset = countGroups(*a);
+  for (unsigned i = 0; i < b->size(); i++) {
+    SelCond c = (*b)[i];
+    c.group += offset;
+    a->push_back(c);
+  }
+  delete b;
+  return a;
+}
+
+// the most groups the AND of two lists may expand into
+static const int MAX_GROUPS = 4096;
+
+// the AND of two lists of conditions: a group for every group of a ANDed
+// with every group of b. NULL if that multiplies the groups of both
+// lists into too many; a list of one group only adds to the others.
+static std::vector<SelCond>* andConditions(std::vector<SelCond>* a, std::vector<SelCond>* b)
+{
+  int na = countGroups(*a);
+  int nb = countGroups(*b);
+  if (na == 1 && nb == 1) {
+    a->insert(a->end(), b->begin(), b->end());
+    delete b;
+    return a;
+  }
+
+  std::vector<SelCond>* result = NULL;
+  if (na == 1 || nb == 1 || (long long) na * nb <= MAX_GROUPS) {
+    result = new std::vector<SelCond>;
+    for (int i = 0; i < na; i++) {
+      for (int j = 0; j < nb; j++) {
+        for (unsigned k = 0; k < a->size(); k++) {
+          if ((*a)[k].group != i) continue;
+          SelCond c = (*a)[k];
+          c.value = strdup(c.value);
+          c.group = i * nb + j;
+          result->push_back(c);
+        }
+        for (unsigned k = 0; k < b->size(); k++) {
+          if ((*b)[k].group != j) continue;
+          SelCond c = (*b)[k];
+          c.value = strdup(c.value);
+          c.group = i * nb + j;
+          result->push_back(c);
+        }
+      }
+    }
+  }
+  freeConditions(a);
+  freeConditions(b);
+  return result;
+}
+
 %}
 
 %union {
@@ -34,17 +163,45 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   char* string;
   SelCond* cond;
   std::vector<SelCond>* conds;
+  std::vector<char*>* strings;
+  SelOrder* order;
+  JoinColumn* column;
+  std::vector<JoinColumn>* columns;
+  JoinCond* jcond;
+  std::vector<JoinCond>* jconds;
 }
 
-%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
-%token COMMA STAR LF
+%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT MIN MAX SUM AVG AND OR OPTIMIZE LEARNED HASH CLUSTERED PIN UNPIN CREATE ON EXPLAIN 
+%token ORDER BY ASC DESC LIMIT IN GROUP
+%token COMMA STAR LPAREN RPAREN DOT LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
+%type <integer> attributes attribute aggregate comparator grouping sort_key
 %type <string> table value
 %type <cond> condition
-%type <conds> conditions
+%type <conds> conditions conjunction term
+%type <strings> values
+%type <order> order ordering
+%type <column> column
+%type <columns> columns
+%type <jcond> join_condition
+%type <jconds> join_conditions
+
+%destructor { freeConditions($$); } <conds>
+%destructor {
+  for (unsigned i = 0; i < $$->size(); i++) free((*$$)[i]);
+  delete $$;
+} <strings>
+%destructor { free($$->table); delete $$; } <column>
+%destructor { freeColumns($$); } <columns>
+%destructor {
+  free($$->column.table);
+  free($$->value);
+  free($$->other.table);
+  delete $$;
+} <jcond>
+%destructor { freeJoinConditions($$); } <jconds>
 %%
 
 commands:
@@ -55,6 +212,10 @@ commands:
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
+	| explain_command { fprintf(stdout, "Bruinbase> "); }
+	| create_command { fprintf(stdout, "Bruinbase> "); }
+	| optimize_command { fprintf(stdout, "Bruinbase> "); }
+	| pin_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
 	| LF { fprintf(stdout, "Bruinbase> "); }
@@ -66,44 +227,235 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::NO_INDEX); 
 	  free($2);
 	  free($4);
 	}
 	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::BTREE_INDEX); 
+	  free($2);
+	  free($4);
+	}
+	| LOAD table FROM STRING WITH LEARNED INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::LEARNED_INDEX); 
+	  free($2);
+	  free($4);
+	}
+	| LOAD table FROM STRING WITH HASH INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::HASH_INDEX); 
 	  free($2);
 	  free($4);
 	}
+	| LOAD table FROM STRING WITH CLUSTERED INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::CLUSTERED_INDEX); 
+	  free($2);
+	  free($4);
+	}
+	;
+
+create_command:
+	CREATE INDEX ON table LPAREN attribute RPAREN LF {
+	  SqlEngine::createIndex(std::string($4), $6);
+	  free($4);
+	}
+	;
+
+optimize_command:
+	OPTIMIZE INDEX table LF {
+	  SqlEngine::optimizeIndex(std::string($3));
+	  free($3);
+	}
+	;
+
+pin_command:
+	PIN table LF {
+	  SqlEngine::pin(std::string($2));
+	  free($2);
+	}
+	| UNPIN table LF {
+	  SqlEngine::unpin(std::string($2));
+	  free($2);
+	}
 	;
 
 select_command:
-	SELECT attributes FROM table LF {
+	SELECT attributes FROM table grouping order LF {
    	        std::vector<SelCond> conds;
-		runSelect($2, $4, conds);
+		int attr = groupedAttr($2, $5);
+		if (attr > 0) runSelect(attr, $4, conds, *$6);
 		free($4);
+		delete $6;
 	}
-	| SELECT attributes FROM table WHERE conditions LF {
-	        runSelect($2, $4, *$6);
+	| SELECT attributes FROM table WHERE conditions grouping order LF {
+		int attr = groupedAttr($2, $7);
+	        if (attr > 0) runSelect(attr, $4, *$6, *$8);
 	  	free($4);
 	  	for (unsigned i = 0; i < $6->size(); i++) {
 		    free((*$6)[i].value);
 		}
 	  	delete $6;
+		delete $8;
+	}
+	| SELECT attributes FROM table COMMA table WHERE join_conditions LF {
+		std::vector<JoinColumn> columns;
+		if ($2 == 3 || $2 == 4) runJoin($2, columns, $4, $6, *$8);
+		else sqlerror("the columns of a join must name their table, as in t.key");
+		free($4);
+		free($6);
+		freeJoinConditions($8);
+	}
+	| SELECT columns FROM table COMMA table WHERE join_conditions LF {
+		runJoin(0, *$2, $4, $6, *$8);
+		freeColumns($2);
+		free($4);
+		free($6);
+		freeJoinConditions($8);
 	}
 	;
 
+explain_command:
+	EXPLAIN SELECT attributes FROM table grouping order LF {
+   	        std::vector<SelCond> conds;
+		int attr = groupedAttr($3, $6);
+		if (attr > 0) SqlEngine::select(attr, $5, conds, *$7, true);
+		free($5);
+		delete $7;
+	}
+	| EXPLAIN SELECT attributes FROM table WHERE conditions grouping order LF {
+		int attr = groupedAttr($3, $8);
+	        if (attr > 0) SqlEngine::select(attr, $5, *$7, *$9, true);
+	  	free($5);
+	  	for (unsigned i = 0; i < $7->size(); i++) {
+		    free((*$7)[i].value);
+		}
+	  	delete $7;
+		delete $9;
+	}
+	| EXPLAIN SELECT attributes FROM table COMMA table WHERE join_conditions LF {
+		std::vector<JoinColumn> columns;
+		if ($3 == 3 || $3 == 4) SqlEngine::join($3, columns, $5, $7, *$9, true);
+		else sqlerror("the columns of a join must name their table, as in t.key");
+		free($5);
+		free($7);
+		freeJoinConditions($9);
+	}
+	| EXPLAIN SELECT columns FROM table COMMA table WHERE join_conditions LF {
+		SqlEngine::join(0, *$3, $5, $7, *$9, true);
+		freeColumns($3);
+		free($5);
+		free($7);
+		freeJoinConditions($9);
+	}
+	;
+
+grouping:
+	/* empty */ { $$ = 0; }
+	| GROUP BY attribute { $$ = $3; }
+	;
+
+order:
+	ordering { $$ = $1; }
+	| ordering LIMIT INTEGER {
+	  $$ = $1;
+	  $$->limit = atoi($3);
+	  free($3);
+	  if ($$->limit < 0) {
+	    sqlerror("LIMIT must not be negative");
+	    delete $$;
+	    YYERROR;
+	  }
+	}
+	;
+
+ordering:
+	/* empty */ {
+	  $$ = new SelOrder;
+	  $$->attr  = 0;
+	  $$->desc  = false;
+	  $$->limit = -1;
+	}
+	| ORDER BY sort_key {
+	  $$ = new SelOrder;
+	  $$->attr  = $3;
+	  $$->desc  = false;
+	  $$->limit = -1;
+	}
+	| ORDER BY sort_key ASC {
+	  $$ = new SelOrder;
+	  $$->attr  = $3;
+	  $$->desc  = false;
+	  $$->limit = -1;
+	}
+	| ORDER BY sort_key DESC {
+	  $$ = new SelOrder;
+	  $$->attr  = $3;
+	  $$->desc  = true;
+	  $$->limit = -1;
+	}
+	;
+
+sort_key:
+	attribute { $$ = $1; }
+	| COUNT   { $$ = 4; }
+	;
+
 conditions:
+	conjunction { $$ = $1; }
+	| conditions OR conjunction {
+	  $$ = orConditions($1, $3);
+	}
+	;
+
+conjunction:
+	term { $$ = $1; }
+	| conjunction AND term {
+	  $$ = andConditions($1, $3);
+	  if ($$ == NULL) {
+	    sqlerror("too many OR terms");
+	    YYERROR;
+	  }
+	}
+	;
+
+term:
 	condition {
 	  std::vector<SelCond>* v = new std::vector<SelCond>;
 	  v->push_back(*$1);
 	  $$ = v;
           delete $1;
 	}
-	| conditions AND condition {
-	  $1->push_back(*$3);
-	  $$ = $1;
-          delete $3;
+	| LPAREN conditions RPAREN { $$ = $2; }
+	| attribute IN LPAREN values RPAREN {
+	  std::vector<SelCond>* v = new std::vector<SelCond>;
+	  if ($1 == 1) {
+	    // the keys stay one condition in one group, so ANDing the list
+	    // with other conditions does not multiply the groups
+	    std::string keys;
+	    char        key[16];
+	    for (unsigned i = 0; i < $4->size(); i++) {
+	      snprintf(key, sizeof(key), i > 0 ? ",%d" : "%d", atoi((*$4)[i]));
+	      keys += key;
+	      free((*$4)[i]);
+	    }
+	    SelCond c;
+	    c.attr  = 1;
+	    c.comp  = SelCond::IN_KEYS;
+	    c.value = strdup(keys.c_str());
+	    c.group = 0;
+	    v->push_back(c);
+	  } else {
+	    // one group for every value in the list
+	    for (unsigned i = 0; i < $4->size(); i++) {
+	      SelCond c;
+	      c.attr  = $1;
+	      c.comp  = SelCond::EQ;
+	      c.value = (*$4)[i];
+	      c.group = i;
+	      v->push_back(c);
+	    }
+	  }
+	  $$ = v;
+	  delete $4;
 	}
 	;
 
@@ -113,14 +465,103 @@ condition:
 	  c->attr = $1;
 	  c->comp = static_cast<SelCond::Comparator>($2);
 	  c->value = $3;
+	  c->group = 0;
 	  $$ = c;
         }
 	;
 
+join_conditions:
+	join_condition {
+	  $$ = new std::vector<JoinCond>;
+	  $$->push_back(*$1);
+	  delete $1;
+	}
+	| join_conditions AND join_condition {
+	  $1->push_back(*$3);
+	  $$ = $1;
+	  delete $3;
+	}
+	;
+
+join_condition:
+	column comparator value {
+	  $$ = new JoinCond;
+	  $$->column = *$1;
+	  $$->comp = static_cast<SelCond::Comparator>($2);
+	  $$->value = $3;
+	  $$->other.table = NULL;
+	  $$->other.attr = 0;
+	  delete $1;
+	}
+	| column comparator column {
+	  $$ = new JoinCond;
+	  $$->column = *$1;
+	  $$->comp = static_cast<SelCond::Comparator>($2);
+	  $$->value = NULL;
+	  $$->other = *$3;
+	  delete $1;
+	  delete $3;
+	}
+	;
+
+columns:
+	column {
+	  $$ = new std::vector<JoinColumn>;
+	  $$->push_back(*$1);
+	  delete $1;
+	}
+	| columns COMMA column {
+	  $1->push_back(*$3);
+	  $$ = $1;
+	  delete $3;
+	}
+	;
+
+column:
+	ID DOT attribute {
+	  $$ = new JoinColumn;
+	  $$->table = $1;
+	  $$->attr = $3;
+	}
+	;
+
+values:
+	value {
+	  $$ = new std::vector<char*>;
+	  $$->push_back($1);
+	}
+	| values COMMA value {
+	  $1->push_back($3);
+	  $$ = $1;
+	}
+	;
+
 attributes:
 	attribute { $$ = $1; }
 	| STAR  { $$ = 3; }
 	| COUNT { $$ = 4; }
+	| attribute COMMA COUNT {
+		if ($1 == 2) $$ = 11;
+		else {
+			sqlerror("only the value can be selected with COUNT(*)");
+			YYERROR;
+		}
+	}
+	| aggregate LPAREN attribute RPAREN {
+		if ($3 == 1) $$ = $1;
+		else if ($1 == 5 || $1 == 6) $$ = $1 + 4;
+		else {
+			sqlerror("SUM and AVG only take the key");
+			YYERROR;
+		}
+	}
+	;
+
+aggregate:
+	MIN   { $$ = 5; }
+	| MAX { $$ = 6; }
+	| SUM { $$ = 7; }
+	| AVG { $$ = 8; }
 	;
 
 attribute:
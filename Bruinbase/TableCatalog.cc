@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "TableCatalog.h"
+#include "RecordFile.h"
+
+using std::string;
+using std::vector;
+
+const int TableCatalog::HISTOGRAM_BUCKETS;
+
+// the catalog is a single page
+static const PageId CATALOG_PID = 0;
+
+
+TableCatalog::TableCatalog()
+{
+  memset(&stats, 0, sizeof(stats));
+  totalLength = 0;
+}
+
+RC TableCatalog::read(const string& table)
+{
+  RC       rc;
+  PageFile pf;
+  char     page[PageFile::PAGE_SIZE];
+
+  if ((rc = pf.open(table + ".cat", 'r')) < 0) return rc;
+  if (pf.endPid() == 0) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+  if ((rc = pf.read(CATALOG_PID, page)) < 0) {
+    pf.close();
+    return rc;
+  }
+  memcpy(&stats, page, sizeof(stats));
+  return pf.close();
+}
+
+RC TableCatalog::write(const string& table)
+{
+  RC       rc;
+  PageFile pf;
+  char     page[PageFile::PAGE_SIZE];
+
+  remove((table + ".cat").c_str());
+  if ((rc = pf.open(table + ".cat", 'w')) < 0) return rc;
+
+  memset(page, 0, sizeof(page));
+  memcpy(page, &stats, sizeof(stats));
+  if ((rc = pf.write(CATALOG_PID, page)) < 0) {
+    pf.close();
+    return rc;
+  }
+  return pf.close();
+}
+
+void TableCatalog::addTuple(int key, const string& value)
+{
+  // RecordFile truncates the values it stores
+  int length = std::min<int>(value.size(), RecordFile::MAX_VALUE_LENGTH - 1);
+
+  if (keys.empty() || length < stats.minValueLength) stats.minValueLength = length;
+  if (keys.empty() || length > stats.maxValueLength) stats.maxValueLength = length;
+  totalLength += length;
+  keys.push_back(key);
+}
+
+void TableCatalog::finish(int pageCount)
+{
+  const int n = keys.size();
+
+  stats.rowCount       = n;
+  stats.pageCount      = pageCount;
+  stats.avgValueLength = n > 0 ? totalLength / n : 0;
+  stats.numBuckets     = std::min(n, (int) HISTOGRAM_BUCKETS);
+  if (n == 0) return;
+
+  sort(keys.begin(), keys.end());
+  stats.minKey       = keys[0];
+  stats.maxKey       = keys[n - 1];
+  stats.distinctKeys = 1;
+  for (int i = 1; i < n; i++) {
+    if (keys[i] != keys[i - 1]) stats.distinctKeys++;
+  }
+
+  // bucket i starts at the (i * n / numBuckets)'th smallest key
+  for (int i = 0; i < stats.numBuckets; i++) {
+    stats.bounds[i] = keys[(long long) i * n / stats.numBuckets];
+  }
+  stats.bounds[stats.numBuckets] = keys[n - 1];
+
+  vector<int>().swap(keys);
+}
+
+double TableCatalog::estimateRange(int minKey, int maxKey) const
+{
+  if (stats.rowCount == 0 || minKey > maxKey) return 0;
+  if (maxKey < stats.minKey || minKey > stats.maxKey) return 0;
+
+  // a single key matches the average number of rows per distinct key
+  if (minKey == maxKey) return (double) stats.rowCount / stats.distinctKeys;
+
+  // every bucket holds the same share of the rows, spread evenly over
+  // its key range
+  const double rowsPerBucket = (double) stats.rowCount / stats.numBuckets;
+  double rows = 0;
+  for (int i = 0; i < stats.numBuckets; i++) {
+    const double lo = stats.bounds[i];
+    const double hi = stats.bounds[i + 1];
+    const double from = std::max<double>(lo, minKey);
+    const double to   = std::min<double>(hi, maxKey);
+    if (from > to) continue;
+    rows += rowsPerBucket * (to - from + 1) / (hi - lo + 1);
+  }
+  return std::min<double>(rows, stats.rowCount);
+}
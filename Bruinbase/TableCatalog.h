@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef TABLECATALOG_H
+#define TABLECATALOG_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * The statistics of a table, stored in a one-page catalog file next to
+ * the table (<table>.cat) and rewritten by every LOAD.
+ * The catalog records the row count, the page count of the table file,
+ * the key range, the number of distinct keys, the value length range
+ * and average, and an equi-depth histogram of the keys: the keys are
+ * cut into HISTOGRAM_BUCKETS buckets holding the same number of rows,
+ * and the catalog stores the bucket boundaries. Assuming the keys are
+ * spread evenly inside a bucket, the boundaries give an estimate of the
+ * number of rows in any key range.
+ */
+class TableCatalog {
+ public:
+  static const int HISTOGRAM_BUCKETS = 64;
+
+  TableCatalog();
+
+  /**
+   * read the catalog of a table.
+   * @param table[IN] the table name
+   * @return error code. 0 if no error
+   */
+  RC read(const std::string& table);
+
+  /**
+   * write the catalog of a table, replacing the old one.
+   * @param table[IN] the table name
+   * @return error code. 0 if no error
+   */
+  RC write(const std::string& table);
+
+  /**
+   * add a tuple of the table to the statistics being collected.
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple
+   */
+  void addTuple(int key, const std::string& value);
+
+  /**
+   * compute the statistics over all tuples added by addTuple().
+   * @param pageCount[IN] the number of pages in the table file
+   */
+  void finish(int pageCount);
+
+  /**
+   * estimate the number of rows whose keys are in [minKey, maxKey].
+   * @param minKey[IN] the smallest key in the range
+   * @param maxKey[IN] the largest key in the range
+   * @return the estimated number of rows
+   */
+  double estimateRange(int minKey, int maxKey) const;
+
+  int    getRowCount() const       { return stats.rowCount; }
+  int    getPageCount() const      { return stats.pageCount; }
+  int    getMinKey() const         { return stats.minKey; }
+  int    getMaxKey() const         { return stats.maxKey; }
+  int    getDistinctKeys() const   { return stats.distinctKeys; }
+  int    getMinValueLength() const { return stats.minValueLength; }
+  int    getMaxValueLength() const { return stats.maxValueLength; }
+  double getAvgValueLength() const { return stats.avgValueLength; }
+
+ private:
+  // the statistics as they are laid out in the catalog page
+  struct Stats {
+    int    rowCount;
+    int    pageCount;
+    int    minKey;
+    int    maxKey;
+    int    distinctKeys;
+    int    minValueLength;
+    int    maxValueLength;
+    double avgValueLength;
+    int    numBuckets;
+    // bucket i holds the keys in [bounds[i], bounds[i+1]]
+    int    bounds[HISTOGRAM_BUCKETS + 1];
+  } stats;
+
+  std::vector<int> keys;         // the keys added by addTuple()
+  double           totalLength;  // the total value length added
+};
+
+#endif // TABLECATALOG_H
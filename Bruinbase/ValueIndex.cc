@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "ValueIndex.h"
+
+using std::string;
+using std::vector;
+
+const int ValueIndex::PREFIX_LENGTH;
+
+// the layout of a leaf node page
+struct ValueLeaf {
+  int        count;  // the number of entries in the node
+  PageId     next;   // the next leaf node, or -1
+  ValueEntry entries[ValueIndex::LEAF_ENTRIES];
+};
+
+// the layout of a non-leaf node page. entries[i].key is the first entry
+// in the subtree of entries[i].child; all entries before it are under
+// the previous child (or under first, for i = 0).
+struct ValueNonLeaf {
+  int    count;  // the number of separator entries in the node
+  PageId first;  // the leftmost child
+  struct {
+    ValueEntry key;
+    PageId     child;
+  } entries[ValueIndex::NONLEAF_ENTRIES];
+};
+
+// the meta page slots
+enum { META_ROOT_PID, META_TREE_HEIGHT, META_NUM_ENTRIES };
+
+// order the entries by (prefix, rid) so that every entry is distinct
+static bool valueEntryLess(const ValueEntry& a, const ValueEntry& b)
+{
+  int diff = memcmp(a.prefix, b.prefix, ValueIndex::PREFIX_LENGTH);
+  if (diff != 0) return diff < 0;
+  return a.rid < b.rid;
+}
+
+
+ValueIndex::ValueIndex()
+{
+  pfMode     = 'r';
+  rootPid    = -1;
+  treeHeight = 0;
+  numEntries = 0;
+}
+
+RC ValueIndex::open(const string& indexname, char mode)
+{
+  RC  rc;
+  int meta[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if ((rc = pf.open(indexname, mode)) < 0) return rc;
+  pfMode = mode;
+
+  if (pf.endPid() > 0) {
+    if ((rc = pf.read(META_PID, meta)) < 0) {
+      pf.close();
+      return rc;
+    }
+    rootPid    = meta[META_ROOT_PID];
+    treeHeight = meta[META_TREE_HEIGHT];
+    numEntries = meta[META_NUM_ENTRIES];
+  }
+
+  return 0;
+}
+
+RC ValueIndex::close()
+{
+  RC  rc;
+  int meta[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if (pfMode == 'w') {
+    memset(meta, 0, sizeof(meta));
+    meta[META_ROOT_PID]    = rootPid;
+    meta[META_TREE_HEIGHT] = treeHeight;
+    meta[META_NUM_ENTRIES] = numEntries;
+    if ((rc = pf.write(META_PID, meta)) < 0) return rc;
+  }
+
+  return pf.close();
+}
+
+RC ValueIndex::build(vector<ValueEntry>& entries)
+{
+  RC rc;
+
+  if (pfMode != 'w' || pf.endPid() > 0) return RC_INVALID_FILE_MODE;
+
+  numEntries = entries.size();
+  if (entries.empty()) return 0;
+  sort(entries.begin(), entries.end(), valueEntryLess);
+
+  // the first entry and the pid of every node on the level being built
+  vector<ValueEntry> levelKeys;
+  vector<PageId>     levelPids;
+
+  // pack the leaves and chain them together in page order
+  const int numLeaves = (entries.size() + LEAF_ENTRIES - 1) / LEAF_ENTRIES;
+  PageId    pid       = META_PID + 1;
+  for (int i = 0; i < numLeaves; i++, pid++) {
+    ValueLeaf leaf;
+    memset(&leaf, 0, sizeof(leaf));
+    const int first = i * LEAF_ENTRIES;
+    const int last  = std::min<int>(first + LEAF_ENTRIES, entries.size());
+    leaf.count = last - first;
+    leaf.next  = i + 1 < numLeaves ? pid + 1 : -1;
+    std::copy(entries.begin() + first, entries.begin() + last, leaf.entries);
+
+    char page[PageFile::PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+    memcpy(page, &leaf, sizeof(leaf));
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+
+    levelKeys.push_back(entries[first]);
+    levelPids.push_back(pid);
+  }
+  treeHeight = 1;
+
+  // build the non-leaf levels until a single node is left. the children
+  // are spread evenly, so every node gets at least two of them.
+  while (levelPids.size() > 1) {
+    vector<ValueEntry> parentKeys;
+    vector<PageId>     parentPids;
+
+    const int numChildren = levelPids.size();
+    const int numNodes    = (numChildren + NONLEAF_ENTRIES) / (NONLEAF_ENTRIES + 1);
+    int child = 0;
+    for (int i = 0; i < numNodes; i++, pid++) {
+      const int size = numChildren / numNodes + (i < numChildren % numNodes ? 1 : 0);
+
+      ValueNonLeaf node;
+      memset(&node, 0, sizeof(node));
+      node.first = levelPids[child];
+      node.count = size - 1;
+      for (int j = 1; j < size; j++) {
+        node.entries[j - 1].key   = levelKeys[child + j];
+        node.entries[j - 1].child = levelPids[child + j];
+      }
+
+      char page[PageFile::PAGE_SIZE];
+      memset(page, 0, sizeof(page));
+      memcpy(page, &node, sizeof(node));
+      if ((rc = pf.write(pid, page)) < 0) return rc;
+
+      parentKeys.push_back(levelKeys[child]);
+      parentPids.push_back(pid);
+      child += size;
+    }
+
+    levelKeys.swap(parentKeys);
+    levelPids.swap(parentPids);
+    treeHeight++;
+  }
+  rootPid = levelPids[0];
+
+  return 0;
+}
+
+RC ValueIndex::locate(const string& value, IndexCursor& cursor)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  cursor.pid = -1;
+  cursor.eid = 0;
+  if (rootPid < 0) return 0;
+
+  // descend into the last child whose first entry is below the prefix;
+  // entries equal to the prefix may start at the end of that child
+  PageId pid = rootPid;
+  for (int height = treeHeight; height > 1; height--) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    ValueNonLeaf* node = (ValueNonLeaf*) page;
+    pid = node->first;
+    for (int i = 0; i < node->count && comparePrefix(node->entries[i].key, value) < 0; i++) {
+      pid = node->entries[i].child;
+    }
+  }
+
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+  ValueLeaf* leaf = (ValueLeaf*) page;
+  int eid = 0;
+  while (eid < leaf->count && comparePrefix(leaf->entries[eid], value) < 0) eid++;
+
+  // the first match is at the start of the next leaf
+  if (eid == leaf->count) {
+    pid = leaf->next;
+    eid = 0;
+  }
+  cursor.pid = pid;
+  cursor.eid = eid;
+  return 0;
+}
+
+RC ValueIndex::readForward(IndexCursor& cursor, ValueEntry& entry)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  if (cursor.pid < 0) return RC_INVALID_CURSOR;
+  if ((rc = pf.read(cursor.pid, page)) < 0) return rc;
+
+  ValueLeaf* leaf = (ValueLeaf*) page;
+  if (cursor.eid >= leaf->count) return RC_INVALID_CURSOR;
+  entry = leaf->entries[cursor.eid];
+
+  if (++cursor.eid == leaf->count) {
+    cursor.pid = leaf->next;
+    cursor.eid = 0;
+  }
+  return 0;
+}
+
+void ValueIndex::makeEntry(const string& value, int key, const RecordId& rid, ValueEntry& entry)
+{
+  memset(entry.prefix, 0, PREFIX_LENGTH);
+  memcpy(entry.prefix, value.data(), std::min<int>(value.size(), PREFIX_LENGTH));
+  entry.key = key;
+  entry.rid = rid;
+}
+
+int ValueIndex::comparePrefix(const ValueEntry& entry, const string& value)
+{
+  char prefix[PREFIX_LENGTH];
+  memset(prefix, 0, PREFIX_LENGTH);
+  memcpy(prefix, value.data(), std::min<int>(value.size(), PREFIX_LENGTH));
+  return memcmp(entry.prefix, prefix, PREFIX_LENGTH);
+}
+
+bool ValueIndex::isExact(const ValueEntry& entry)
+{
+  return memchr(entry.prefix, 0, PREFIX_LENGTH) != NULL;
+}
+
+string ValueIndex::prefixOf(const ValueEntry& entry)
+{
+  const char* end = (const char*) memchr(entry.prefix, 0, PREFIX_LENGTH);
+  return string(entry.prefix, end != NULL ? end - entry.prefix : PREFIX_LENGTH);
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef VALUEINDEX_H
+#define VALUEINDEX_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "BTreeIndex.h"
+
+/**
+ * An entry of the value index: a prefix of the value of a tuple,
+ * followed by the key and the RecordId of the tuple.
+ * The prefix is padded with zero bytes, so a value shorter than
+ * ValueIndex::PREFIX_LENGTH is stored in full.
+ */
+typedef struct {
+  // the first PREFIX_LENGTH bytes of the value
+  char     prefix[24];
+  // the key of the tuple
+  int      key;
+  // the RecordId of the tuple
+  RecordId rid;
+} ValueEntry;
+
+/**
+ * A secondary B+tree index on the value column of a table.
+ * Values are truncated to a fixed-length prefix, which keeps the nodes
+ * at a fixed layout with a useful fanout. Since different values may
+ * share a prefix, and the value column is not unique anyway, the entries
+ * are ordered by (prefix, rid) and a lookup returns a range of
+ * candidates that the caller checks against the full value. For values
+ * shorter than the prefix the entry itself holds the full value (see
+ * isExact()), so the record does not have to be read to check it.
+ *
+ * The index is built in one go from the table with build(); the leaves
+ * are packed and chained in order, and the non-leaf levels are written
+ * bottom-up above them. Page 0 holds the root pid, the tree height and
+ * the number of entries.
+ */
+class ValueIndex {
+ public:
+  static const int META_PID      = 0;
+  static const int PREFIX_LENGTH = sizeof(((ValueEntry*) 0)->prefix);
+
+  /// the number of entries in a leaf node
+  static const int LEAF_ENTRIES =
+    (PageFile::PAGE_SIZE - 2 * sizeof(int)) / sizeof(ValueEntry);
+
+  /// the number of separator entries in a non-leaf node
+  static const int NONLEAF_ENTRIES =
+    (PageFile::PAGE_SIZE - 2 * sizeof(int)) / (sizeof(ValueEntry) + sizeof(PageId));
+
+  ValueIndex();
+
+  /**
+   * open the index file in read or write mode.
+   * under 'w' mode, the file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * close the index file, writing back the meta page under 'w' mode.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * build the whole index from the entries of every tuple in the table.
+   * the index must be open in 'w' mode on an empty file.
+   * @param entries[IN/OUT] the entries to store; they are sorted in place
+   * @return error code. 0 if no error
+   */
+  RC build(std::vector<ValueEntry>& entries);
+
+  /**
+   * find the first entry whose prefix is larger than or equal to the
+   * prefix of the given value.
+   * @param value[IN] the value to find
+   * @param cursor[OUT] the cursor pointing to the entry; pid is -1 if
+   * there is no such entry
+   * @return error code. 0 if no error
+   */
+  RC locate(const std::string& value, IndexCursor& cursor);
+
+  /**
+   * read the entry at the cursor and move the cursor forward.
+   * @param cursor[IN/OUT] the cursor pointing to a leaf-node entry
+   * @param entry[OUT] the entry stored at the cursor location
+   * @return error code. 0 if no error
+   */
+  RC readForward(IndexCursor& cursor, ValueEntry& entry);
+
+  /**
+   * fill in an entry for a tuple.
+   * @param value[IN] the value of the tuple
+   * @param key[IN] the key of the tuple
+   * @param rid[IN] the RecordId of the tuple
+   * @param entry[OUT] the entry for the tuple
+   */
+  static void makeEntry(const std::string& value, int key, const RecordId& rid, ValueEntry& entry);
+
+  /**
+   * compare the prefix of an entry with the prefix of a value.
+   * @return negative, zero or positive like strcmp()
+   */
+  static int comparePrefix(const ValueEntry& entry, const std::string& value);
+
+  /**
+   * @return true if the prefix of the entry is the whole value
+   */
+  static bool isExact(const ValueEntry& entry);
+
+  /**
+   * @return the value (if isExact()) or its prefix stored in the entry
+   */
+  static std::string prefixOf(const ValueEntry& entry);
+
+ private:
+  PageFile pf;          // the PageFile used to store the nodes
+  char     pfMode;      // the mode the file was opened in
+  PageId   rootPid;     // the pid of the root node, -1 if empty
+  int      treeHeight;  // the number of levels, 0 if empty
+  int      numEntries;  // the number of entries in the index
+};
+
+#endif // VALUEINDEX_H
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <unistd.h>
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+{
+  task       = NULL;
+  numStarted = 0;
+  window     = 0;
+  released   = 0;
+  cancelled  = false;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&changed, NULL);
+}
+
+WorkerPool::~WorkerPool()
+{
+  wait();
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+}
+
+RC WorkerPool::start(MorselTask* task, int numMorsels, int numWorkers, int window)
+{
+  this->task   = task;
+  this->window = window;
+  released     = 0;
+  cancelled    = false;
+  done.assign(numMorsels, 0);
+  if (numWorkers < 1) numWorkers = 1;
+
+  // the queues are filled before any thread starts, so the workers
+  // never see a queue being dealt
+  workers.resize(numWorkers);
+  for (int i = 0; i < numWorkers; i++) {
+    workers[i].pool  = this;
+    workers[i].index = i;
+    pthread_mutex_init(&workers[i].lock, NULL);
+  }
+  for (int m = 0; m < numMorsels; m++) {
+    workers[m % numWorkers].morsels.push_back(m);
+  }
+  for (int i = 0; i < numWorkers; i++) {
+    workers[i].front = 0;
+    workers[i].back  = workers[i].morsels.size();
+  }
+
+  // the morsels of a worker that could not be started are stolen by the
+  // others, so the task is done as long as one thread runs
+  for (int i = 0; i < numWorkers; i++) {
+    if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0) break;
+    numStarted++;
+  }
+  if (numStarted == 0) {
+    for (int i = 0; i < numWorkers; i++) pthread_mutex_destroy(&workers[i].lock);
+    workers.clear();
+    return RC_THREAD_FAILED;
+  }
+  if (numStarted < numWorkers) {
+    // a queue without its owner is only emptied from the back, so the
+    // lowest morsel could be left behind the window; drop the window
+    pthread_mutex_lock(&lock);
+    this->window = 0;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+  }
+
+  return 0;
+}
+
+void WorkerPool::wait()
+{
+  for (int i = 0; i < numStarted; i++) pthread_join(workers[i].thread, NULL);
+  numStarted = 0;
+
+  for (unsigned i = 0; i < workers.size(); i++) pthread_mutex_destroy(&workers[i].lock);
+  workers.clear();
+}
+
+void WorkerPool::waitFor(int morsel)
+{
+  pthread_mutex_lock(&lock);
+  while (!done[morsel]) pthread_cond_wait(&changed, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+void WorkerPool::release()
+{
+  pthread_mutex_lock(&lock);
+  released++;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+void WorkerPool::cancel()
+{
+  pthread_mutex_lock(&lock);
+  cancelled = true;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+int WorkerPool::processorCount()
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count < 1 ? 1 : (int) count;
+}
+
+void* WorkerPool::work(void* arg)
+{
+  Worker* self = (Worker*) arg;
+  int     morsel;
+
+  while (self->pool->take(self->index, morsel)) self->pool->runMorsel(morsel);
+  return NULL;
+}
+
+// run a morsel once the window reaches it, and mark it done.
+// a worker only waits on a morsel above the lowest one not released, and
+// that one is next in the queue of a worker that is not waiting, so
+// the workers cannot all end up waiting for each other.
+void WorkerPool::runMorsel(int morsel)
+{
+  bool skip;
+
+  pthread_mutex_lock(&lock);
+  while (!cancelled && window > 0 && morsel >= released + window) {
+    pthread_cond_wait(&changed, &lock);
+  }
+  skip = cancelled;
+  pthread_mutex_unlock(&lock);
+
+  if (!skip) task->run(morsel);
+
+  pthread_mutex_lock(&lock);
+  done[morsel] = 1;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+// take the next morsel for a worker: the lowest of its own queue, or else
+// the highest of the first other queue that has any left
+bool WorkerPool::take(int index, int& morsel)
+{
+  int numWorkers = workers.size();
+
+  for (int i = 0; i < numWorkers; i++) {
+    Worker& victim = workers[(index + i) % numWorkers];
+    bool    found  = false;
+
+    pthread_mutex_lock(&victim.lock);
+    if (victim.front < victim.back) {
+      morsel = (i == 0) ? victim.morsels[victim.front++] : victim.morsels[--victim.back];
+      found  = true;
+    }
+    pthread_mutex_unlock(&victim.lock);
+
+    if (found) return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <pthread.h>
+#include <vector>
+#include "Bruinbase.h"
+
+/**
+ * A piece of work split into morsels numbered 0 to numMorsels - 1,
+ * which a WorkerPool runs on several threads at once.
+ */
+class MorselTask {
+ public:
+  virtual ~MorselTask() {}
+
+  /**
+   * process one morsel. called from the worker threads, so run() must
+   * be safe to call for different morsels at the same time.
+   * @param morsel[IN] the morsel to process
+   */
+  virtual void run(int morsel) = 0;
+};
+
+/**
+ * Worker threads running the morsels of a task.
+ * The morsels are dealt round robin into a queue per worker, so the
+ * workers start together on the first morsels and the low morsels are
+ * done first. A worker takes the lowest morsel left in its own queue;
+ * once its queue is empty it steals the highest morsel left in another
+ * worker's queue, so a worker held up by slow morsels does not leave the
+ * others idle at the end. A worker stops when every queue is empty.
+ *
+ * When the results of the morsels are consumed in order, the consumer
+ * waits for each with waitFor() and hands it back with release(); with
+ * a window, the workers stay at most that many morsels ahead of the
+ * consumer, which bounds the results held in memory.
+ */
+class WorkerPool {
+ public:
+  WorkerPool();
+
+  /**
+   * wait for the workers, if they were started.
+   */
+  ~WorkerPool();
+
+  /**
+   * start the worker threads on the morsels of a task and return without
+   * waiting for them. a pool runs one task.
+   * @param task[IN] the task; it must outlive the workers
+   * @param numMorsels[IN] the number of morsels of the task
+   * @param numWorkers[IN] the number of threads to start
+   * @param window[IN] if positive, a morsel is not run until the ones
+   * more than window below it have been released
+   * @return error code. 0 if no error
+   */
+  RC start(MorselTask* task, int numMorsels, int numWorkers, int window = 0);
+
+  /**
+   * wait until a morsel has been run, or skipped after cancel().
+   * @param morsel[IN] the morsel to wait for
+   */
+  void waitFor(int morsel);
+
+  /**
+   * hand back the lowest morsel not released yet, once the consumer is
+   * done with its result, so the workers may move one morsel further.
+   */
+  void release();
+
+  /**
+   * skip the morsels that have not been started yet.
+   */
+  void cancel();
+
+  /**
+   * wait until every morsel has been run and the workers have stopped.
+   */
+  void wait();
+
+  /**
+   * @return the number of processors online, at least 1
+   */
+  static int processorCount();
+
+ private:
+  // the morsels dealt to one worker. morsels[front..back) are left;
+  // the owner takes from the front and thieves from the back.
+  struct Worker {
+    WorkerPool*      pool;
+    int              index;
+    pthread_t        thread;
+    pthread_mutex_t  lock;
+    std::vector<int> morsels;
+    unsigned         front;
+    unsigned         back;
+  };
+
+  static void* work(void* arg);
+  bool take(int index, int& morsel);
+  void runMorsel(int morsel);
+
+  MorselTask*         task;
+  std::vector<Worker> workers;
+  int                 numStarted;  // the number of threads running
+
+  pthread_mutex_t   lock;       // guards the members below
+  pthread_cond_t    changed;    // signaled when any of them changes
+  std::vector<char> done;       // whether each morsel has been run
+  int               window;
+  int               released;   // the number of morsels released
+  bool              cancelled;
+};
+
+#endif // WORKERPOOL_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Compares checking the keys of a batch one at a time with
+ * Predicate::matchesKey() and selecting them with Predicate::selectKeys().
+ * usage: bench_filter [batches]
+ * The keys are random in [0, 1000000), in batches of TupleBatch::CAPACITY,
+ * and the condition is a key range that selects 1% to 100% of them.
+ * Both report M keys/s. selectKeys() uses the AVX2 kernel when the CPU
+ * has it; build with BENCHFLAGS="-O2 -DNO_AVX2" to measure the scalar one.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Bench.h"
+#include "Operator.h"
+#include "Predicate.h"
+
+using namespace std;
+
+static const int KEY_RANGE = 1000000;
+
+int main(int argc, char* argv[])
+{
+  int batches = argc > 1 ? atoi(argv[1]) : 40000;
+  int n       = TupleBatch::CAPACITY;
+
+  srand(143);
+  vector<int> keys(batches * n);
+  for (unsigned i = 0; i < keys.size(); i++) keys[i] = rand() % KEY_RANGE;
+
+#if !defined(NO_AVX2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  const char* kernel = __builtin_cpu_supports("avx2") ? "avx2" : "scalar";
+#else
+  const char* kernel = "scalar";
+#endif
+  fprintf(stdout, "%d batches of %d keys, selectKeys() kernel: %s\n", batches, n, kernel);
+  fprintf(stdout, "selectivity  row-at-a-time  selectKeys\n");
+
+  static const int percents[] = { 1, 10, 50, 90, 100 };
+  vector<int> sel(n);
+  char        hi[16];
+  for (unsigned p = 0; p < sizeof(percents) / sizeof(percents[0]); p++) {
+    // key >= 0 AND key < percent of the key range
+    snprintf(hi, sizeof(hi), "%d", KEY_RANGE / 100 * percents[p]);
+    vector<SelCond> cond(2);
+    cond[0].attr  = cond[1].attr = 1;
+    cond[0].group = cond[1].group = 0;
+    cond[0].comp  = SelCond::GE;
+    cond[0].value = (char*) "0";
+    cond[1].comp  = SelCond::LT;
+    cond[1].value = hi;
+    Predicate pred(cond);
+
+    int    rowCount = 0;
+    double start    = benchNow();
+    for (int b = 0; b < batches; b++) {
+      const int* batch = &keys[b * n];
+      int        count = 0;
+      for (int i = 0; i < n; i++) {
+        if (pred.matchesKey(batch[i])) sel[count++] = i;
+      }
+      rowCount += count;
+    }
+    double rowSeconds = benchNow() - start;
+
+    int selCount = 0;
+    start = benchNow();
+    for (int b = 0; b < batches; b++) {
+      selCount += pred.selectKeys(&keys[b * n], n, &sel[0]);
+    }
+    double selSeconds = benchNow() - start;
+
+    if (rowCount != selCount) {
+      fprintf(stderr, "Error: %d keys selected one at a time, %d by selectKeys()\n", rowCount, selCount);
+      return 1;
+    }
+    fprintf(stdout, "%10d%%  %13.0f  %10.0f\n", percents[p],
+            keys.size() / rowSeconds / 1e6, keys.size() / selSeconds / 1e6);
+  }
+  return 0;
+}
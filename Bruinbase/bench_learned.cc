@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Compares locate() on a bulk-loaded B+tree with the learned index.
+ * usage: bench_learned [loadfile | number of keys] [lookups]
+ * The keys are read from a load file (xlarge.del by default) or, given a
+ * number, generated with random gaps of 1 to 16. Both indexes are built
+ * from the same entries in bench_btree.idx and bench_learned.idx, which
+ * are removed afterwards. Half of the lookups hit a key and half miss.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Bench.h"
+#include "BTreeIndex.h"
+#include "SqlEngine.h"
+
+using namespace std;
+
+static bool entryLess(const IndexEntry& a, const IndexEntry& b)
+{
+  return a.key < b.key;
+}
+
+static RC readKeys(const string& loadfile, vector<IndexEntry>& entries)
+{
+  ifstream in(loadfile.c_str());
+  if (!in.is_open()) return RC_FILE_OPEN_FAILED;
+
+  string line, value;
+  IndexEntry entry;
+  entry.rid.pid = entry.rid.sid = 0;
+  while (getline(in, line)) {
+    if (SqlEngine::parseLoadLine(line, entry.key, value) < 0) return RC_INVALID_FILE_FORMAT;
+    entries.push_back(entry);
+    ++entry.rid.sid;
+  }
+
+  // the index needs strictly ascending keys
+  stable_sort(entries.begin(), entries.end(), entryLess);
+  vector<IndexEntry> unique;
+  for (unsigned i = 0; i < entries.size(); i++) {
+    if (unique.empty() || unique.back().key != entries[i].key) unique.push_back(entries[i]);
+  }
+  entries.swap(unique);
+  return 0;
+}
+
+static void makeKeys(int n, vector<IndexEntry>& entries)
+{
+  IndexEntry entry;
+  entry.key = 0;
+  for (int i = 0; i < n; i++) {
+    entry.key += 1 + rand() % 16;
+    entry.rid.pid = i / 80;
+    entry.rid.sid = i % 80;
+    entries.push_back(entry);
+  }
+}
+
+// build an index over the entries and time locate() for the probe keys
+static RC run(const char* label, const string& indexname, bool learned,
+              const vector<IndexEntry>& entries, const vector<int>& probes)
+{
+  BTreeIndex index;
+  RC rc;
+
+  remove(indexname.c_str());
+  if ((rc = index.open(indexname, 'w')) < 0) return rc;
+  rc = learned ? index.bulkLoadLearned(entries) : index.bulkLoad(entries);
+  index.close();
+  if (rc < 0) return rc;
+
+  if ((rc = index.open(indexname, 'r')) < 0) return rc;
+  if (learned && !index.isLearned()) {
+    fprintf(stderr, "the segments did not fit the meta page; the learned run is a B+tree\n");
+  }
+
+  int         reads = PageFile::getPageReadCount();
+  double      start = benchNow();
+  IndexCursor cursor;
+  for (unsigned i = 0; i < probes.size(); i++) {
+    if ((rc = index.locate(probes[i], cursor)) < 0 && rc != RC_NO_SUCH_RECORD) break;
+  }
+  double seconds = benchNow() - start;
+  reads = PageFile::getPageReadCount() - reads;
+  int pages = index.getPageCount();
+  index.close();
+  remove(indexname.c_str());
+  if (rc < 0 && rc != RC_NO_SUCH_RECORD) return rc;
+
+  fprintf(stdout, "%-8s %8d pages  %6.2f us/lookup  %5.2f pages/lookup\n",
+          label, pages, seconds * 1e6 / probes.size(),
+          (double) reads / probes.size());
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  string source  = argc > 1 ? argv[1] : "xlarge.del";
+  int    lookups = argc > 2 ? atoi(argv[2]) : 200000;
+
+  srand(143);
+  vector<IndexEntry> entries;
+  if (atoi(source.c_str()) > 0) {
+    makeKeys(atoi(source.c_str()), entries);
+  } else if (readKeys(source, entries) < 0) {
+    fprintf(stderr, "Error: cannot read the keys of %s\n", source.c_str());
+    return 1;
+  }
+  if (entries.empty()) {
+    fprintf(stderr, "Error: no keys\n");
+    return 1;
+  }
+
+  // half of the probes are keys of the index, half fall between them
+  vector<int> probes;
+  for (int i = 0; i < lookups; i++) {
+    const IndexEntry& e = entries[rand() % entries.size()];
+    probes.push_back(i % 2 ? e.key : e.key + 1);
+  }
+  fprintf(stdout, "%d keys, %d lookups\n", (int) entries.size(), lookups);
+
+  RC rc;
+  if ((rc = run("btree", "bench_btree.idx", false, entries, probes)) < 0 ||
+      (rc = run("learned", "bench_learned.idx", true, entries, probes)) < 0) {
+    fprintf(stderr, "Error: building the index failed (%d)\n", rc);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Compares parsing a load file with LoadFile and with getline() and
+ * SqlEngine::parseLoadLine() on one thread.
+ * usage: bench_loadfile [rows] [workers]
+ * The file bench_load.del is generated with 1M rows by default, about
+ * 16MB, and removed afterwards. LoadFile runs with one worker unless
+ * told otherwise. Only parsing is timed; nothing is appended to a table.
+ * Both report M rows/s. Build with BENCHFLAGS="-O2 -DNO_AVX2" to time
+ * the memchr loop instead of the AVX2 newline kernel.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "Bench.h"
+#include "LoadFile.h"
+#include "SqlEngine.h"
+
+using namespace std;
+
+static const char* const LOADFILE = "bench_load.del";
+
+int main(int argc, char* argv[])
+{
+  int rows    = argc > 1 ? atoi(argv[1]) : 1000000;
+  int workers = argc > 2 ? atoi(argv[2]) : 1;
+
+  // keys of up to 6 digits, every third value quoted with '
+  FILE* out = fopen(LOADFILE, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Error: cannot create %s\n", LOADFILE);
+    return 1;
+  }
+  srand(143);
+  for (int i = 0; i < rows; i++) {
+    if (i % 3) fprintf(out, "%d,\"M%d\"\n", rand() % 1000000, i);
+    else       fprintf(out, "%d,'M%d'\n", rand() % 1000000, i);
+  }
+  fclose(out);
+
+  // read the file once so that both runs find it in the page cache
+  string line, value;
+  int    key;
+  long   sum = 0;
+  {
+    ifstream in(LOADFILE);
+    while (getline(in, line)) sum += line.size() + 1;
+  }
+
+  int    count    = 0;
+  long   plainSum = 0;
+  double start    = benchNow();
+  ifstream in(LOADFILE);
+  while (getline(in, line)) {
+    if (SqlEngine::parseLoadLine(line, key, value) < 0) break;
+    plainSum += key + value.size();
+    count++;
+  }
+  in.close();
+  double plain = benchNow() - start;
+
+  LoadFile input;
+  bool     found;
+  int      loadCount = 0;
+  long     loadSum   = 0;
+  RC       rc;
+  start = benchNow();
+  if ((rc = input.open(LOADFILE, workers)) == 0) {
+    while ((rc = input.next(key, value, found)) == 0 && found) {
+      loadSum += key + value.size();
+      loadCount++;
+    }
+  }
+  double mapped = benchNow() - start;
+  remove(LOADFILE);
+
+  if (rc < 0 || count != rows || loadCount != rows || loadSum != plainSum) {
+    fprintf(stderr, "Error: the parsers disagree (rc %d, %d and %d rows)\n", rc, count, loadCount);
+    return 1;
+  }
+  fprintf(stdout, "%d rows, %.1f MB\n", rows, sum / 1e6);
+  fprintf(stdout, "getline+parseLoadLine: %.1f M rows/s\n", rows / plain / 1e6);
+  fprintf(stdout, "LoadFile, %d worker(s): %.1f M rows/s\n", workers, rows / mapped / 1e6);
+  return 0;
+}
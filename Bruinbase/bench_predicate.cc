@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Compares the compiled Predicate with checking every condition of a
+ * WHERE clause per tuple, as select() did before it.
+ * usage: bench_predicate [loadfile] [runs]
+ * The WHERE clause has two conditions on the key and two on the value.
+ * "full query" loads the file (xlarge.del by default) into the table
+ * bench_scan without an index and runs SELECT COUNT(*) over it; "filter
+ * alone" checks the tuples, held in memory, against the conditions
+ * 10 times as often. Both report M rows/s. The full query measures the
+ * select() of the tree the driver is built in.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Bench.h"
+#include "Predicate.h"
+#include "SqlEngine.h"
+
+using namespace std;
+
+// the files SqlEngine::load() writes for a table
+static const char* const tableFiles[] = { ".tbl", ".idx", ".blm", ".cat", ".zmp", ".vdx", ".hsh", ".iot" };
+
+static void removeTable(const string& table)
+{
+  for (unsigned i = 0; i < sizeof(tableFiles) / sizeof(tableFiles[0]); i++) {
+    remove((table + tableFiles[i]).c_str());
+  }
+}
+
+// the per-tuple check of the conditions that select() ran before the
+// Predicate, kept here as the baseline
+static bool matchesConds(const vector<SelCond>& cond, int key, const string& value)
+{
+  int diff = 0;
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    // compute the difference between the tuple value and the condition value
+    switch (cond[i].attr) {
+      case 1:
+        diff = key - atoi(cond[i].value);
+        break;
+      case 2:
+        diff = strcmp(value.c_str(), cond[i].value);
+        break;
+    }
+
+    // skip the tuple if any condition is not met
+    switch (cond[i].comp) {
+      case SelCond::EQ:
+        if (diff != 0) return false;
+        break;
+      case SelCond::NE:
+        if (diff == 0) return false;
+        break;
+      case SelCond::GT:
+        if (diff <= 0) return false;
+        break;
+      case SelCond::LT:
+        if (diff >= 0) return false;
+        break;
+      case SelCond::GE:
+        if (diff < 0) return false;
+        break;
+      case SelCond::LE:
+        if (diff > 0) return false;
+        break;
+      case SelCond::IN_KEYS:
+        // came after this check; the driver has no IN lists
+        break;
+    }
+  }
+  return true;
+}
+
+static void addCond(vector<SelCond>& cond, int attr, SelCond::Comparator comp, const char* value)
+{
+  SelCond c;
+  c.attr  = attr;
+  c.comp  = comp;
+  c.value = strdup(value);
+  c.group = 0;
+  cond.push_back(c);
+}
+
+int main(int argc, char* argv[])
+{
+  string loadfile = argc > 1 ? argv[1] : "xlarge.del";
+  int    runs     = argc > 2 ? atoi(argv[2]) : 100;
+
+  vector<SelCond> cond;
+  addCond(cond, 1, SelCond::GT, "1000000");
+  addCond(cond, 1, SelCond::LT, "1500000000");
+  addCond(cond, 2, SelCond::GT, "B");
+  addCond(cond, 2, SelCond::LT, "T");
+
+  // read the tuples for the filter alone
+  ifstream in(loadfile.c_str());
+  if (!in.is_open()) {
+    fprintf(stderr, "Error: cannot open %s\n", loadfile.c_str());
+    return 1;
+  }
+  vector<int>    keys;
+  vector<string> values;
+  string         line, value;
+  int            key;
+  while (getline(in, line)) {
+    if (SqlEngine::parseLoadLine(line, key, value) < 0) continue;
+    keys.push_back(key);
+    values.push_back(value);
+  }
+  in.close();
+
+  double rows = (double) keys.size() * runs * 10;
+  int    count;
+  double start = benchNow();
+  count = 0;
+  for (int r = 0; r < runs * 10; r++) {
+    for (unsigned i = 0; i < keys.size(); i++) {
+      if (matchesConds(cond, keys[i], values[i])) count++;
+    }
+  }
+  double before = benchNow() - start;
+
+  Predicate pred(cond);
+  int compiled = 0;
+  start = benchNow();
+  for (int r = 0; r < runs * 10; r++) {
+    for (unsigned i = 0; i < keys.size(); i++) {
+      if (pred.matches(keys[i], values[i])) compiled++;
+    }
+  }
+  double after = benchNow() - start;
+  if (compiled != count) {
+    fprintf(stderr, "Error: %d tuples match per tuple, %d with the Predicate\n", count, compiled);
+    return 1;
+  }
+  fprintf(stdout, "filter alone: per tuple %.1f, Predicate %.1f M rows/s (%d matches)\n",
+          rows / before / 1e6, rows / after / 1e6, count / (runs * 10));
+
+  // the full query; its counts go to /dev/null
+  removeTable("bench_scan");
+  if (SqlEngine::load("bench_scan", loadfile, SqlEngine::NO_INDEX) < 0) return 1;
+
+  SelOrder order;
+  order.attr  = 0;
+  order.desc  = false;
+  order.limit = -1;
+
+  fflush(stdout);
+  int saved = dup(1);
+  int null  = open("/dev/null", O_WRONLY);
+  dup2(null, 1);
+  start = benchNow();
+  RC rc = 0;
+  for (int r = 0; r < runs && rc == 0; r++) {
+    rc = SqlEngine::select(4, "bench_scan", cond, order);
+  }
+  double query = benchNow() - start;
+  fflush(stdout);
+  dup2(saved, 1);
+  close(null);
+  close(saved);
+  removeTable("bench_scan");
+  if (rc < 0) {
+    fprintf(stderr, "Error: the query failed (%d)\n", rc);
+    return 1;
+  }
+  fprintf(stdout, "full query: %.1f M rows/s\n", (double) keys.size() * runs / query / 1e6);
+  return 0;
+}
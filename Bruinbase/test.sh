@@ -1,10 +1,12 @@
 #!/bin/sh
 
-rm -f xsmall.tbl xsmall.idx
-rm -f small.tbl small.idx
-rm -f medium.tbl medium.idx
-rm -f large.tbl large.idx
-rm -f xlarge.tbl xlarge.idx
+# remove the tables and every file kept next to them
+for table in xsmall small medium large xlarge unindexed spill; do
+  rm -f $table.tbl $table.idx $table.blm $table.cat $table.zmp $table.vdx $table.hsh $table.iot
+done
 
-./bruinbase < test.sql
+# 70000 rows with 68000 distinct values, more groups than GROUP BY counts
+# in memory; the last 2000 rows repeat values first seen after the limit
+awk 'BEGIN { for (i = 0; i < 70000; i++) printf "%d,\"group %05d\"\n", i, i < 68000 ? i : i - 2000 }' > spill.del
 
+./bruinbase < test.sql
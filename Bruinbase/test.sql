@@ -20,3 +20,43 @@ SELECT COUNT(*) FROM xlarge
 SELECT * FROM xlarge WHERE key = 4240
 SELECT * FROM xlarge WHERE key > 400 AND key < 500 AND key > 100 AND key < 4000000
 
+LOAD xlarge FROM 'append.del' WITH INDEX
+SELECT COUNT(*) FROM xlarge
+SELECT COUNT(*) FROM xlarge WHERE key > 21234 AND key < 23661
+SELECT * FROM xlarge WHERE key >= 21318 AND key <= 23661
+
+SELECT * FROM large WHERE key > 4500 ORDER BY key DESC LIMIT 3
+SELECT * FROM medium ORDER BY value LIMIT 4
+SELECT key FROM small WHERE key < 400 ORDER BY value DESC
+SELECT * FROM xlarge ORDER BY key LIMIT 2
+
+SELECT * FROM small WHERE key IN (173, 303, 489, 9999)
+SELECT * FROM small WHERE key < 50 OR key > 4600
+SELECT COUNT(*) FROM large WHERE key > 4500 AND key <> 4506
+SELECT * FROM medium WHERE (key = 489 OR value = 'Bananas') AND key < 1000
+EXPLAIN SELECT * FROM large WHERE key IN (4506, 4515) OR key > 4700
+SELECT * FROM large WHERE key IN (4506, 4515) OR key > 4700
+
+LOAD unindexed FROM 'medium.del'
+SELECT * FROM xsmall, unindexed WHERE xsmall.key = unindexed.key
+SELECT small.key, unindexed.value FROM small, unindexed WHERE small.key = unindexed.key AND small.key < 200
+EXPLAIN SELECT COUNT(*) FROM large, unindexed WHERE large.key = unindexed.key
+SELECT COUNT(*) FROM large, unindexed WHERE large.key = unindexed.key
+EXPLAIN SELECT COUNT(*) FROM small, medium WHERE small.key = medium.key
+SELECT COUNT(*) FROM small, medium WHERE small.key = medium.key
+EXPLAIN SELECT unindexed.key, xlarge.value FROM unindexed, xlarge WHERE unindexed.key = xlarge.key AND unindexed.key < 50
+SELECT unindexed.key, xlarge.value FROM unindexed, xlarge WHERE unindexed.key = xlarge.key AND unindexed.key < 50
+SELECT xsmall.key, large.key FROM xsmall, large WHERE xsmall.value = large.value
+
+SELECT value FROM small WHERE key < 300 GROUP BY value ORDER BY value
+SELECT value, COUNT(*) FROM xlarge WHERE value >= 'Hard' AND value < 'Hare' GROUP BY value ORDER BY value
+LOAD spill FROM 'spill.del'
+EXPLAIN SELECT value, COUNT(*) FROM spill GROUP BY value ORDER BY value DESC LIMIT 3
+SELECT value, COUNT(*) FROM spill GROUP BY value ORDER BY value DESC LIMIT 3
+SELECT value, COUNT(*) FROM spill GROUP BY value ORDER BY value LIMIT 2
+LOAD large FROM 'append.del'
+SELECT COUNT(*) FROM large
+SELECT COUNT(*) FROM large WHERE key > 0
+SELECT * FROM large WHERE key = 21305
+SELECT * FROM xlarge WHERE key IN (24161234, 41231234, 3061234, 18861234, 29381234, 7) AND key < 30000000 AND key <> 3061234
+SELECT * FROM xlarge WHERE key IN (24161234, 41231234, 3061234, 18861234) AND value > 'I' AND key IN (41231234, 18861234, 3061234)